@@ -0,0 +1,226 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+//           :
+//  IPv4/IPv6     ,     
+enum class AddressKind : uint8_t {
+    Invalid,
+    IPv4,
+    IPv6,
+    Hostname
+};
+
+//    ,     (IPv4 -  4 )
+struct ParsedAddress {
+    AddressKind kind = AddressKind::Invalid;
+    uint8_t bytes[16] = {};
+
+    bool is_literal() const {
+        return kind == AddressKind::IPv4 || kind == AddressKind::IPv6;
+    }
+
+    int family() const {
+        return kind == AddressKind::IPv6 ? AF_INET6 : AF_INET;
+    }
+
+    //   ;     sendto/connect
+    socklen_t to_sockaddr(sockaddr_storage& storage, uint16_t port = 0) const {
+        std::memset(&storage, 0, sizeof(storage));
+        if (kind == AddressKind::IPv6) {
+            auto* address = reinterpret_cast<sockaddr_in6*>(&storage);
+            address->sin6_family = AF_INET6;
+            address->sin6_port = htons(port);
+            std::memcpy(&address->sin6_addr, bytes, 16);
+            return sizeof(sockaddr_in6);
+        }
+        auto* address = reinterpret_cast<sockaddr_in*>(&storage);
+        address->sin_family = AF_INET;
+        address->sin_port = htons(port);
+        std::memcpy(&address->sin_addr, bytes, 4);
+        return sizeof(sockaddr_in);
+    }
+};
+
+//     ,    ( inet_pton)
+inline bool parse_ipv4(std::string_view text, uint8_t* out) {
+    size_t position = 0;
+    for (int octet = 0; octet < 4; ++octet) {
+        if (octet > 0) {
+            if (position >= text.size() || text[position] != '.') {
+                return false;
+            }
+            position++;
+        }
+        size_t start = position;
+        unsigned value = 0;
+        while (position < text.size() && text[position] >= '0' && text[position] <= '9' && position - start < 3) {
+            value = value * 10 + (text[position] - '0');
+            position++;
+        }
+        size_t digits = position - start;
+        if (digits == 0 || value > 255 || (digits > 1 && text[start] == '0')) {
+            return false;
+        }
+        out[octet] = static_cast<uint8_t>(value);
+    }
+    return position == text.size();
+}
+
+//     1-4  ,  "::"  IPv4   (RFC 4291, 2.2).
+//   ("%eth0")  ,    inet_pton
+inline bool parse_ipv6(std::string_view text, uint8_t* out) {
+    uint8_t words[16] = {};
+    int count = 0;     //  
+    int gap = -1;      //  "::"  
+    size_t position = 0;
+
+    if (text.size() >= 2 && text[0] == ':' && text[1] == ':') {
+        gap = 0;
+        position = 2;
+    }
+    else if (!text.empty() && text[0] == ':') {
+        return false;
+    }
+
+    while (position < text.size()) {
+        if (count == 16) {
+            return false;
+        }
+        size_t start = position;
+        unsigned value = 0;
+        while (position < text.size() && position - start < 5) {
+            char c = text[position];
+            unsigned digit;
+            if (c >= '0' && c <= '9') digit = c - '0';
+            else if (c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F') digit = c - 'A' + 10;
+            else break;
+            value = (value << 4) | digit;
+            position++;
+        }
+        size_t digits = position - start;
+
+        if (position < text.size() && text[position] == '.') {
+            //  IPv4    
+            if (count > 12 || !parse_ipv4(text.substr(start), words + count)) {
+                return false;
+            }
+            count += 4;
+            position = text.size();
+            break;
+        }
+        if (digits == 0 || digits > 4) {
+            return false;
+        }
+        words[count++] = static_cast<uint8_t>(value >> 8);
+        words[count++] = static_cast<uint8_t>(value);
+
+        if (position == text.size()) {
+            break;
+        }
+        if (text[position] != ':') {
+            return false;
+        }
+        position++;
+        if (position < text.size() && text[position] == ':') {
+            if (gap >= 0) {
+                return false;
+            }
+            gap = count;
+            position++;
+        }
+        else if (position == text.size()) {
+            //  ':'  
+            return false;
+        }
+    }
+
+    if (gap < 0) {
+        if (count != 16) {
+            return false;
+        }
+        std::memcpy(out, words, 16);
+        return true;
+    }
+    if (count == 16) {
+        // "::"      
+        return false;
+    }
+    int tail = count - gap;
+    std::memset(out, 0, 16);
+    std::memcpy(out, words, gap);
+    std::memcpy(out + 16 - tail, words + gap, tail);
+    return true;
+}
+
+//    RFC 1123:  1-63   , , '-'  '_' (
+//   ),  '-'  ,   253 ,    .
+//       ,  "10.0.0.256"    
+inline bool is_hostname(std::string_view text) {
+    if (!text.empty() && text.back() == '.') {
+        text.remove_suffix(1);
+    }
+    if (text.empty() || text.size() > 253) {
+        return false;
+    }
+
+    size_t label_start = 0;
+    bool label_numeric = true;
+    for (size_t i = 0; i <= text.size(); ++i) {
+        if (i == text.size() || text[i] == '.') {
+            size_t length = i - label_start;
+            if (length == 0 || length > 63 || text[label_start] == '-' || text[i - 1] == '-') {
+                return false;
+            }
+            if (i == text.size()) {
+                return !label_numeric;
+            }
+            label_start = i + 1;
+            label_numeric = true;
+            continue;
+        }
+        char c = text[i];
+        bool digit = c >= '0' && c <= '9';
+        bool letter = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+        if (!digit && !letter && c != '-' && c != '_') {
+            return false;
+        }
+        label_numeric = label_numeric && digit;
+    }
+    return false;
+}
+
+inline ParsedAddress classify_address(std::string_view text) {
+    ParsedAddress result;
+    if (parse_ipv4(text, result.bytes)) {
+        result.kind = AddressKind::IPv4;
+    }
+    else if (text.find(':') != std::string_view::npos) {
+        if (parse_ipv6(text, result.bytes)) {
+            result.kind = AddressKind::IPv6;
+        }
+    }
+    else if (is_hostname(text)) {
+        result.kind = AddressKind::Hostname;
+    }
+    return result;
+}
+
+//  ,         .
+// results      ;    
+inline size_t classify_addresses(const std::vector<std::string>& addresses, std::vector<ParsedAddress>& results) {
+    results.resize(addresses.size());
+    size_t valid = 0;
+    for (size_t i = 0; i < addresses.size(); ++i) {
+        results[i] = classify_address(addresses[i]);
+        valid += results[i].kind != AddressKind::Invalid;
+    }
+    return valid;
+}
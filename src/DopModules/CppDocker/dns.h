@@ -0,0 +1,1037 @@
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <functional>
+#include <memory>
+#include <random>
+#include <algorithm>
+#include <limits>
+#include <cstring>
+#include <cerrno>
+#include <charconv>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "address.h"
+
+//     
+struct ResolvedAddress {
+    int family = AF_INET; // AF_INET  AF_INET6
+    std::string address;
+};
+
+//   
+struct DnsAnswer {
+    std::vector<ResolvedAddress> addresses; //  IPv4
+    std::chrono::seconds ttl{ 0 };          //  TTL  
+    bool transient = false;                 //   ,     
+    std::string error;                      //   ,     
+};
+
+//  DNS :  A  AAAA    UDP   
+// /etc/resolv.conf,     TCP,   -  
+//  .       epoll,    .
+//         ,   : 
+//  ,    ,   .     
+//  max_queries:       ,   
+//  .
+class DnsResolver {
+public:
+    using Clock = std::chrono::steady_clock;
+    using Callback = std::function<void(DnsAnswer)>;
+
+    DnsResolver() {
+        load_config("/etc/resolv.conf");
+        poller_ = epoll_create1(EPOLL_CLOEXEC);
+        wakeup_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (poller_ < 0 || wakeup_ < 0) {
+            throw std::runtime_error("Cannot initialize DNS resolver");
+        }
+        watch(wakeup_, EPOLLIN);
+        running_ = true;
+        thread_ = std::thread(&DnsResolver::run, this);
+    }
+
+    DnsResolver(const DnsResolver&) = delete;
+    DnsResolver& operator=(const DnsResolver&) = delete;
+
+    ~DnsResolver() {
+        stop();
+        close(wakeup_);
+        close(poller_);
+    }
+
+    //  "ip", "ip:port"  "[ipv6]:port"    resolv.conf;  
+    //    ,   
+    bool set_nameservers(const std::vector<std::string>& servers) {
+        if (servers.empty()) {
+            return false;
+        }
+        std::vector<sockaddr_storage> parsed;
+        for (const auto& server : servers) {
+            sockaddr_storage address;
+            if (!parse_server(server, address)) {
+                return false;
+            }
+            parsed.push_back(address);
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        servers_ = std::move(parsed);
+        return true;
+    }
+
+    //         
+    void set_timeout(std::chrono::milliseconds timeout, int attempts) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        timeout_ = timeout;
+        attempts_ = std::max(1, attempts);
+    }
+
+    //   ; done       
+    void resolve(const std::string& host, Callback done) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (running_) {
+                incoming_.emplace_back(host, std::move(done));
+                done = nullptr;
+            }
+        }
+        if (done) {
+            DnsAnswer answer;
+            answer.transient = true;
+            done(std::move(answer));
+            return;
+        }
+        wake();
+    }
+
+    //   /etc/hosts;    
+    bool lookup_hosts(const std::string& host, std::vector<ResolvedAddress>& addresses) {
+        std::lock_guard<std::mutex> lock(hosts_mutex_);
+        struct stat info;
+        if (stat("/etc/hosts", &info) == 0 && info.st_mtime != hosts_mtime_) {
+            hosts_mtime_ = info.st_mtime;
+            load_hosts("/etc/hosts");
+        }
+        auto it = hosts_.find(lowercase(host));
+        if (it == hosts_.end()) {
+            return false;
+        }
+        addresses = it->second;
+        return true;
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!running_) return;
+            running_ = false;
+        }
+        wake();
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+    }
+
+private:
+    //   :    search,     A  AAAA
+    struct Request {
+        std::vector<std::string> names;
+        size_t name = 0;
+        Callback done;
+        std::vector<ResolvedAddress> v4;
+        std::vector<ResolvedAddress> v6;
+        uint32_t ttl = std::numeric_limits<uint32_t>::max();
+        int outstanding = 0;
+        bool transient = false;
+        std::vector<sockaddr_storage> servers;
+        std::chrono::milliseconds timeout{};
+        int attempts = 0;
+        std::string error;
+    };
+
+    //    DNS ,    -  
+    struct Query {
+        std::shared_ptr<Request> request;
+        uint16_t type = 0;
+        std::vector<uint8_t> packet;
+        int attempt = 0;
+        Clock::time_point deadline;
+        int udp = -1;                //   
+        int tcp = -1;                //    UDP 
+        std::vector<uint8_t> framed; //      TCP
+        std::vector<uint8_t> stream; //   TCP 
+        size_t written = 0;
+    };
+
+    enum class Outcome { Answer, NoName, Failed };
+
+    static constexpr uint16_t type_a = 1;
+    static constexpr uint16_t type_aaaa = 28;
+    static constexpr uint16_t type_cname = 5;
+    static constexpr size_t max_queries = 256; //   ,    
+
+    void watch(int fd, uint32_t events, int op = EPOLL_CTL_ADD) {
+        epoll_event event{};
+        event.events = events;
+        event.data.fd = fd;
+        epoll_ctl(poller_, op, fd, &event);
+    }
+
+    void wake() {
+        uint64_t value = 1;
+        ssize_t written = write(wakeup_, &value, sizeof(value));
+        (void)written;
+    }
+
+    static std::string lowercase(std::string text) {
+        std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        return text;
+    }
+
+    static bool parse_address(const std::string& text, uint16_t port, sockaddr_storage& address) {
+        addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_DGRAM;
+        hints.ai_flags = AI_NUMERICHOST | AI_NUMERICSERV;
+        addrinfo* info = nullptr;
+        if (getaddrinfo(text.c_str(), std::to_string(port).c_str(), &hints, &info) != 0) {
+            return false;
+        }
+        std::memset(&address, 0, sizeof(address));
+        std::memcpy(&address, info->ai_addr, info->ai_addrlen);
+        freeaddrinfo(info);
+        return true;
+    }
+
+    //  1-65535   ,    
+    static bool parse_port(const std::string& text, uint16_t& port) {
+        unsigned value = 0;
+        auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+        if (text.empty() || error != std::errc() || end != text.data() + text.size() || value == 0 || value > 65535) {
+            return false;
+        }
+        port = static_cast<uint16_t>(value);
+        return true;
+    }
+
+    static bool parse_server(const std::string& server, sockaddr_storage& address) {
+        std::string host = server;
+        uint16_t port = 53;
+        size_t colon = server.rfind(':');
+        if (!server.empty() && server[0] == '[') {
+            size_t end = server.find(']');
+            if (end == std::string::npos) return false;
+            host = server.substr(1, end - 1);
+            if (end + 1 < server.size()) {
+                if (server[end + 1] != ':' || !parse_port(server.substr(end + 2), port)) return false;
+            }
+        }
+        else if (colon != std::string::npos && server.find(':') == colon) {
+            host = server.substr(0, colon);
+            if (!parse_port(server.substr(colon + 1), port)) return false;
+        }
+        return parse_address(host, port, address);
+    }
+
+    static socklen_t address_length(const sockaddr_storage& address) {
+        return address.ss_family == AF_INET6 ? sizeof(sockaddr_in6) : sizeof(sockaddr_in);
+    }
+
+    static bool same_address(const sockaddr_storage& a, const sockaddr_storage& b) {
+        if (a.ss_family != b.ss_family) return false;
+        if (a.ss_family == AF_INET6) {
+            auto& x = reinterpret_cast<const sockaddr_in6&>(a);
+            auto& y = reinterpret_cast<const sockaddr_in6&>(b);
+            return x.sin6_port == y.sin6_port && std::memcmp(&x.sin6_addr, &y.sin6_addr, sizeof(in6_addr)) == 0;
+        }
+        auto& x = reinterpret_cast<const sockaddr_in&>(a);
+        auto& y = reinterpret_cast<const sockaddr_in&>(b);
+        return x.sin_port == y.sin_port && x.sin_addr.s_addr == y.sin_addr.s_addr;
+    }
+
+    // nameserver, search/domain  options ndots/timeout/attempts;   - ,   libc
+    void load_config(const std::string& path) {
+        std::ifstream file(path);
+        std::string line;
+        while (std::getline(file, line)) {
+            std::istringstream words(line);
+            std::string keyword;
+            words >> keyword;
+            if (keyword == "nameserver") {
+                std::string server;
+                sockaddr_storage address;
+                if (words >> server && parse_address(server, 53, address)) {
+                    servers_.push_back(address);
+                }
+            }
+            else if (keyword == "search" || keyword == "domain") {
+                search_.clear();
+                std::string domain;
+                while (words >> domain) {
+                    search_.push_back(domain);
+                }
+            }
+            else if (keyword == "options") {
+                std::string option;
+                while (words >> option) {
+                    size_t colon = option.find(':');
+                    if (colon == std::string::npos) continue;
+                    int value = std::atoi(option.c_str() + colon + 1);
+                    std::string name = option.substr(0, colon);
+                    if (name == "ndots") ndots_ = std::clamp(value, 0, 15);
+                    else if (name == "timeout") timeout_ = std::chrono::seconds(std::clamp(value, 1, 30));
+                    else if (name == "attempts") attempts_ = std::clamp(value, 1, 5);
+                }
+            }
+        }
+        if (servers_.empty()) {
+            sockaddr_storage address;
+            parse_address("127.0.0.1", 53, address);
+            servers_.push_back(address);
+        }
+    }
+
+    void load_hosts(const std::string& path) {
+        hosts_.clear();
+        std::ifstream file(path);
+        std::string line;
+        while (std::getline(file, line)) {
+            line = line.substr(0, line.find('#'));
+            std::istringstream words(line);
+            std::string address, name;
+            if (!(words >> address)) continue;
+            in6_addr buffer;
+            int family = inet_pton(AF_INET, address.c_str(), &buffer) == 1 ? AF_INET
+                : inet_pton(AF_INET6, address.c_str(), &buffer) == 1 ? AF_INET6 : AF_UNSPEC;
+            if (family == AF_UNSPEC) continue;
+            while (words >> name) {
+                auto& addresses = hosts_[lowercase(name)];
+                addresses.push_back({ family, address });
+                std::stable_sort(addresses.begin(), addresses.end(), [](const ResolvedAddress& a, const ResolvedAddress& b) {
+                    return a.family == AF_INET && b.family != AF_INET;
+                });
+            }
+        }
+    }
+
+    //     libc:    (  ndots)    
+    std::vector<std::string> candidates(const std::string& host) const {
+        if (!host.empty() && host.back() == '.') {
+            return { host.substr(0, host.size() - 1) };
+        }
+        std::vector<std::string> names;
+        int dots = static_cast<int>(std::count(host.begin(), host.end(), '.'));
+        if (dots >= ndots_) names.push_back(host);
+        for (const auto& domain : search_) {
+            names.push_back(host + "." + domain);
+        }
+        if (dots < ndots_) names.push_back(host);
+        return names;
+    }
+
+    void run() {
+        epoll_event events[32];
+        while (true) {
+            int count = epoll_wait(poller_, events, 32, next_timeout());
+            for (int i = 0; i < count; ++i) {
+                int fd = events[i].data.fd;
+                if (fd == wakeup_) {
+                    uint64_t value;
+                    while (read(wakeup_, &value, sizeof(value)) > 0) {}
+                }
+                else if (auto udp = udp_.find(fd); udp != udp_.end()) {
+                    receive_udp(fd, udp->second);
+                }
+                else {
+                    handle_tcp(fd, events[i].events);
+                }
+            }
+
+            std::vector<std::pair<std::string, Callback>> incoming;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (!running_) break;
+                incoming.swap(incoming_);
+            }
+            for (auto& [host, done] : incoming) {
+                start(host, std::move(done));
+            }
+            expire();
+        }
+
+        // :      
+        std::vector<std::shared_ptr<Request>> requests;
+        for (auto& [id, query] : queries_) {
+            if (query.udp >= 0) close(query.udp);
+            if (query.tcp >= 0) close(query.tcp);
+            requests.push_back(query.request);
+        }
+        queries_.clear();
+        udp_.clear();
+        tcp_.clear();
+        std::sort(requests.begin(), requests.end());
+        requests.erase(std::unique(requests.begin(), requests.end()), requests.end());
+        for (auto& request : requests) {
+            request->transient = true;
+            complete(*request);
+        }
+        std::vector<std::pair<std::string, Callback>> incoming;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            incoming.swap(incoming_);
+        }
+        for (auto& [host, done] : incoming) {
+            DnsAnswer answer;
+            answer.transient = true;
+            done(std::move(answer));
+        }
+    }
+
+    void start(const std::string& host, Callback done) {
+        auto request = std::make_shared<Request>();
+        request->names = candidates(host);
+        request->done = std::move(done);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            request->servers = servers_;
+            request->timeout = timeout_;
+            request->attempts = attempts_;
+        }
+        if (request->servers.empty()) {
+            request->transient = true;
+            complete(*request);
+            return;
+        }
+        start_name(request);
+    }
+
+    //    A  AAAA   
+    void start_name(const std::shared_ptr<Request>& request) {
+        while (request->name < request->names.size()) {
+            if (queries_.size() + 2 > max_queries) {
+                request->transient = true;
+                request->error = "too many DNS queries in flight";
+                break;
+            }
+            request->outstanding = 0;
+            for (uint16_t type : { type_a, type_aaaa }) {
+                uint16_t id;
+                if (!allocate_id(id)) {
+                    request->transient = true;
+                    request->error = "no free DNS query id";
+                    break;
+                }
+                Query query;
+                query.request = request;
+                query.type = type;
+                if (!build_query(id, request->names[request->name], type, query.packet)) {
+                    break;
+                }
+                queries_.emplace(id, std::move(query));
+                request->outstanding++;
+                send(id);
+            }
+            if (request->outstanding > 0) {
+                return;
+            }
+            if (!request->error.empty()) {
+                break;
+            }
+            request->name++;
+        }
+        complete(*request);
+    }
+
+    //   .  max_queries   65536  ,
+    //      
+    bool allocate_id(uint16_t& id) {
+        for (int attempt = 0; attempt < 64; ++attempt) {
+            id = static_cast<uint16_t>(random_());
+            if (queries_.find(id) == queries_.end()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static bool build_query(uint16_t id, const std::string& name, uint16_t type, std::vector<uint8_t>& packet) {
+        packet = { static_cast<uint8_t>(id >> 8), static_cast<uint8_t>(id), 0x01, 0x00, 0, 1, 0, 0, 0, 0, 0, 0 };
+        size_t start = 0;
+        while (start < name.size()) {
+            size_t end = name.find('.', start);
+            if (end == std::string::npos) end = name.size();
+            size_t length = end - start;
+            if (length == 0 || length > 63) return false;
+            packet.push_back(static_cast<uint8_t>(length));
+            packet.insert(packet.end(), name.begin() + start, name.begin() + end);
+            start = end + 1;
+        }
+        if (packet.size() > 12 + 253) return false;
+        packet.push_back(0);
+        packet.insert(packet.end(), { static_cast<uint8_t>(type >> 8), static_cast<uint8_t>(type), 0, 1 });
+        return true;
+    }
+
+    const sockaddr_storage& server_of(const Query& query) const {
+        const auto& servers = query.request->servers;
+        return servers[query.attempt % servers.size()];
+    }
+
+    //    UDP   :     ,
+    //  connect     .       
+    void send(uint16_t id) {
+        Query& query = queries_[id];
+        const sockaddr_storage& server = server_of(query);
+        close_sockets(query);
+        query.deadline = Clock::now() + query.request->timeout;
+        int fd = socket(server.ss_family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            query.deadline = Clock::now();
+            return;
+        }
+        query.udp = fd;
+        udp_[fd] = id;
+        watch(fd, EPOLLIN);
+        if (connect(fd, reinterpret_cast<const sockaddr*>(&server), address_length(server)) < 0 ||
+            ::send(fd, query.packet.data(), query.packet.size(), 0) < 0) {
+            query.deadline = Clock::now();
+        }
+    }
+
+    void close_sockets(Query& query) {
+        if (query.udp >= 0) {
+            udp_.erase(query.udp);
+            close(query.udp);
+            query.udp = -1;
+        }
+        if (query.tcp >= 0) {
+            tcp_.erase(query.tcp);
+            close(query.tcp);
+            query.tcp = -1;
+        }
+    }
+
+    void retry(uint16_t id) {
+        Query& query = queries_[id];
+        close_sockets(query);
+        query.attempt++;
+        if (query.attempt >= query.request->attempts * static_cast<int>(query.request->servers.size())) {
+            finish(id, Outcome::Failed, nullptr, 0);
+            return;
+        }
+        send(id);
+    }
+
+    //  ,            
+    void receive_udp(int fd, uint16_t id) {
+        uint8_t buffer[4096];
+        while (true) {
+            sockaddr_storage source;
+            socklen_t length = sizeof(source);
+            ssize_t bytes = recvfrom(fd, buffer, sizeof(buffer), 0, reinterpret_cast<sockaddr*>(&source), &length);
+            if (bytes < 0) break;
+            auto it = queries_.find(id);
+            if (it == queries_.end() || it->second.udp != fd) {
+                break;
+            }
+            if (bytes < 12 || static_cast<uint16_t>((buffer[0] << 8) | buffer[1]) != id || !same_address(source, server_of(it->second))) {
+                continue;
+            }
+            handle_response(id, buffer, static_cast<size_t>(bytes), false);
+        }
+    }
+
+    void handle_response(uint16_t id, const uint8_t* data, size_t size, bool tcp) {
+        Query& query = queries_[id];
+        //     ,      
+        size_t question = query.packet.size() - 12;
+        if (size < 12 + question || !(data[2] & 0x80) || data[5] != 1 ||
+            lowercase(std::string(data + 12, data + 12 + question)) != lowercase(std::string(query.packet.begin() + 12, query.packet.end()))) {
+            return;
+        }
+        if ((data[2] & 0x02) && !tcp) {
+            open_tcp(id);
+            return;
+        }
+        switch (data[3] & 0x0f) {
+        case 0:
+            finish(id, Outcome::Answer, data, size);
+            break;
+        case 3:
+            finish(id, Outcome::NoName, nullptr, 0);
+            break;
+        default:
+            retry(id);
+        }
+    }
+
+    void open_tcp(uint16_t id) {
+        Query& query = queries_[id];
+        const sockaddr_storage& server = server_of(query);
+        int fd = socket(server.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            retry(id);
+            return;
+        }
+        if (connect(fd, reinterpret_cast<const sockaddr*>(&server), address_length(server)) < 0 && errno != EINPROGRESS) {
+            close(fd);
+            retry(id);
+            return;
+        }
+        //      TCP
+        close_sockets(query);
+        uint16_t length = static_cast<uint16_t>(query.packet.size());
+        query.framed = { static_cast<uint8_t>(length >> 8), static_cast<uint8_t>(length) };
+        query.framed.insert(query.framed.end(), query.packet.begin(), query.packet.end());
+        query.tcp = fd;
+        query.written = 0;
+        query.stream.clear();
+        query.deadline = Clock::now() + query.request->timeout;
+        tcp_[fd] = id;
+        watch(fd, EPOLLOUT);
+    }
+
+    void handle_tcp(int fd, uint32_t events) {
+        auto found = tcp_.find(fd);
+        if (found == tcp_.end()) return;
+        uint16_t id = found->second;
+        Query& query = queries_[id];
+
+        if (events & EPOLLOUT) {
+            ssize_t bytes = ::send(fd, query.framed.data() + query.written, query.framed.size() - query.written, MSG_NOSIGNAL);
+            if (bytes < 0 && errno != EAGAIN) {
+                retry(id);
+                return;
+            }
+            if (bytes > 0) query.written += static_cast<size_t>(bytes);
+            if (query.written == query.framed.size()) {
+                watch(fd, EPOLLIN, EPOLL_CTL_MOD);
+            }
+            return;
+        }
+
+        uint8_t buffer[4096];
+        ssize_t bytes = recv(fd, buffer, sizeof(buffer), 0);
+        if (bytes <= 0) {
+            if (bytes < 0 && errno == EAGAIN) return;
+            retry(id);
+            return;
+        }
+        query.stream.insert(query.stream.end(), buffer, buffer + bytes);
+        if (query.stream.size() < 2) return;
+        size_t length = (static_cast<size_t>(query.stream[0]) << 8) | query.stream[1];
+        if (query.stream.size() < length + 2) return;
+
+        std::vector<uint8_t> message(query.stream.begin() + 2, query.stream.begin() + 2 + length);
+        handle_response(id, message.data(), message.size(), true);
+        auto it = queries_.find(id);
+        if (it != queries_.end() && it->second.tcp == fd) {
+            retry(id);
+        }
+    }
+
+    static bool skip_name(const uint8_t* data, size_t size, size_t& offset) {
+        while (offset < size) {
+            uint8_t length = data[offset];
+            if ((length & 0xc0) == 0xc0) {
+                offset += 2;
+                return offset <= size;
+            }
+            offset++;
+            if (length == 0) return true;
+            offset += length;
+        }
+        return false;
+    }
+
+    //      TTL     ( CNAME)
+    static void parse_answer(const uint8_t* data, size_t size, uint16_t type, std::vector<ResolvedAddress>& addresses, uint32_t& ttl) {
+        size_t questions = (static_cast<size_t>(data[4]) << 8) | data[5];
+        size_t answers = (static_cast<size_t>(data[6]) << 8) | data[7];
+        size_t offset = 12;
+        for (size_t i = 0; i < questions; ++i) {
+            if (!skip_name(data, size, offset)) return;
+            offset += 4;
+        }
+        for (size_t i = 0; i < answers; ++i) {
+            if (!skip_name(data, size, offset) || offset + 10 > size) return;
+            uint16_t record = static_cast<uint16_t>((data[offset] << 8) | data[offset + 1]);
+            uint32_t record_ttl = (static_cast<uint32_t>(data[offset + 4]) << 24) | (static_cast<uint32_t>(data[offset + 5]) << 16) |
+                (static_cast<uint32_t>(data[offset + 6]) << 8) | data[offset + 7];
+            size_t length = (static_cast<size_t>(data[offset + 8]) << 8) | data[offset + 9];
+            offset += 10;
+            if (offset + length > size) return;
+
+            char text[INET6_ADDRSTRLEN] = {};
+            if (record == type && type == type_a && length == 4) {
+                inet_ntop(AF_INET, data + offset, text, sizeof(text));
+                addresses.push_back({ AF_INET, text });
+                ttl = std::min(ttl, record_ttl);
+            }
+            else if (record == type && type == type_aaaa && length == 16) {
+                inet_ntop(AF_INET6, data + offset, text, sizeof(text));
+                addresses.push_back({ AF_INET6, text });
+                ttl = std::min(ttl, record_ttl);
+            }
+            else if (record == type_cname) {
+                ttl = std::min(ttl, record_ttl);
+            }
+            offset += length;
+        }
+    }
+
+    void finish(uint16_t id, Outcome outcome, const uint8_t* data, size_t size) {
+        auto it = queries_.find(id);
+        if (it == queries_.end()) return;
+        std::shared_ptr<Request> request = it->second.request;
+        close_sockets(it->second);
+        if (outcome == Outcome::Answer) {
+            parse_answer(data, size, it->second.type, it->second.type == type_a ? request->v4 : request->v6, request->ttl);
+        }
+        else if (outcome == Outcome::Failed) {
+            request->transient = true;
+        }
+        queries_.erase(it);
+
+        if (--request->outstanding > 0) return;
+        if (request->v4.empty() && request->v6.empty() && !request->transient) {
+            //   (  ) -     search
+            request->name++;
+            start_name(request);
+            return;
+        }
+        complete(*request);
+    }
+
+    void complete(Request& request) {
+        DnsAnswer answer;
+        answer.addresses = std::move(request.v4);
+        answer.addresses.insert(answer.addresses.end(), request.v6.begin(), request.v6.end());
+        if (!answer.addresses.empty()) {
+            answer.ttl = std::chrono::seconds(request.ttl);
+        }
+        else {
+            answer.transient = request.transient;
+            answer.error = std::move(request.error);
+        }
+        Callback done = std::move(request.done);
+        if (done) {
+            done(std::move(answer));
+        }
+    }
+
+    //      
+    void expire() {
+        auto now = Clock::now();
+        std::vector<uint16_t> expired;
+        for (const auto& [id, query] : queries_) {
+            if (query.deadline <= now) expired.push_back(id);
+        }
+        for (uint16_t id : expired) {
+            if (queries_.find(id) != queries_.end()) {
+                retry(id);
+            }
+        }
+    }
+
+    int next_timeout() const {
+        if (queries_.empty()) return -1;
+        auto next = Clock::time_point::max();
+        for (const auto& [id, query] : queries_) {
+            next = std::min(next, query.deadline);
+        }
+        auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(next - Clock::now()).count() + 1;
+        return static_cast<int>(std::max<long long>(0, wait));
+    }
+
+    int poller_ = -1;
+    int wakeup_ = -1;
+    std::thread thread_;
+    bool running_ = false;
+
+    //    ,    
+    std::mutex mutex_;
+    std::vector<sockaddr_storage> servers_;
+    std::vector<std::string> search_;
+    int ndots_ = 1;
+    std::chrono::milliseconds timeout_{ 5000 };
+    int attempts_ = 2;
+    std::vector<std::pair<std::string, Callback>> incoming_;
+
+    //   
+    std::unordered_map<uint16_t, Query> queries_;
+    std::unordered_map<int, uint16_t> udp_;
+    std::unordered_map<int, uint16_t> tcp_;
+    std::mt19937 random_{ std::random_device{}() };
+
+    std::mutex hosts_mutex_;
+    std::unordered_map<std::string, std::vector<ResolvedAddress>> hosts_;
+    time_t hosts_mtime_ = 0;
+};
+
+//   DNS  ICMP  HTTP .
+//    TTL   DNS,     ( TTL),
+//        TTL,      DNS.
+class DnsCache {
+public:
+    using Clock = std::chrono::steady_clock;
+    using Callback = std::function<void(const std::vector<ResolvedAddress>&)>;
+
+    static DnsCache& instance() {
+        static DnsCache cache;
+        return cache;
+    }
+
+    DnsCache(const DnsCache&) = delete;
+    DnsCache& operator=(const DnsCache&) = delete;
+
+    ~DnsCache() {
+        stop();
+    }
+
+    //     : true,     (   )
+    bool cached(const std::string& host, std::vector<ResolvedAddress>& addresses) {
+        ResolvedAddress literal;
+        if (parse_literal(host, literal)) {
+            addresses = { literal };
+            return true;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find(host);
+        if (it == entries_.end() || Clock::now() >= it->second.expires) {
+            return false;
+        }
+        it->second.last_used = Clock::now();
+        addresses = it->second.addresses;
+        return true;
+    }
+
+    //  ,  IPv4;  ,    .
+    //   done  ,    ;
+    //        
+    void resolve_async(const std::string& host, Callback done) {
+        std::vector<ResolvedAddress> addresses;
+        if (cached(host, addresses)) {
+            done(addresses);
+            return;
+        }
+        bool start = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            entries_[host].last_used = Clock::now();
+            auto it = waiters_.find(host);
+            start = it == waiters_.end();
+            waiters_[host].push_back(std::move(done));
+        }
+        if (start) {
+            begin(host);
+        }
+    }
+
+    //    ,     (HTTP )
+    std::vector<ResolvedAddress> resolve(const std::string& host) {
+        auto promise = std::make_shared<std::promise<std::vector<ResolvedAddress>>>();
+        auto future = promise->get_future();
+        resolve_async(host, [promise](const std::vector<ResolvedAddress>& addresses) {
+            promise->set_value(addresses);
+        });
+        return future.get();
+    }
+
+    //      (AF_UNSPEC - )
+    bool resolve_one(const std::string& host, ResolvedAddress& result, int family = AF_UNSPEC) {
+        for (auto& address : resolve(host)) {
+            if (family == AF_UNSPEC || address.family == family) {
+                result = std::move(address);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    //  ,    
+    void set_negative_ttl(std::chrono::seconds ttl) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        negative_ttl_ = ttl;
+    }
+
+    // DNS  :     
+    DnsResolver& resolver() {
+        return resolver_;
+    }
+
+    size_t size() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return entries_.size();
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!running_) return;
+            running_ = false;
+        }
+        cv_.notify_all();
+        if (refresh_thread_.joinable()) {
+            refresh_thread_.join();
+        }
+        resolver_.stop();
+    }
+
+private:
+    struct Entry {
+        std::vector<ResolvedAddress> addresses;
+        Clock::time_point expires;    //  TTL
+        Clock::time_point refresh_at; //     
+        Clock::time_point last_used;
+    };
+
+    DnsCache() {
+        running_ = true;
+        refresh_thread_ = std::thread(&DnsCache::refresh_loop, this);
+    }
+
+    static bool parse_literal(const std::string& host, ResolvedAddress& result) {
+        ParsedAddress parsed = classify_address(host);
+        if (!parsed.is_literal()) {
+            return false;
+        }
+        result = { parsed.family(), host };
+        return true;
+    }
+
+    //   ,      .
+    // /etc/hosts  ,    "files dns"  nsswitch
+    void begin(const std::string& host) {
+        DnsAnswer answer;
+        if (!is_hostname(host)) {
+            //       ,   NXDOMAIN
+            finish(host, std::move(answer));
+            return;
+        }
+        if (resolver_.lookup_hosts(host, answer.addresses)) {
+            answer.ttl = hosts_ttl_;
+            finish(host, std::move(answer));
+            return;
+        }
+        resolver_.resolve(host, [this, host](DnsAnswer answer) {
+            finish(host, std::move(answer));
+        });
+    }
+
+    void finish(const std::string& host, DnsAnswer answer) {
+        if (!answer.error.empty()) {
+            std::cerr << "DNS lookup of " << host << " failed: " << answer.error << std::endl;
+        }
+        std::vector<Callback> waiters;
+        std::vector<ResolvedAddress> addresses;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            addresses = store(host, std::move(answer));
+            if (auto it = waiters_.find(host); it != waiters_.end()) {
+                waiters = std::move(it->second);
+                waiters_.erase(it);
+            }
+        }
+        for (auto& waiter : waiters) {
+            waiter(addresses);
+        }
+    }
+
+    //      .    DNS
+    //          .
+    //   mutex_
+    std::vector<ResolvedAddress> store(const std::string& host, DnsAnswer result) {
+        auto now = Clock::now();
+        Entry& entry = entries_[host];
+        if (entry.last_used == Clock::time_point()) {
+            entry.last_used = now;
+        }
+
+        std::chrono::seconds ttl;
+        if (result.addresses.empty()) {
+            ttl = result.transient ? std::min(negative_ttl_, transient_ttl_) : negative_ttl_;
+            if (!result.transient || entry.addresses.empty()) {
+                entry.addresses.clear();
+            }
+        }
+        else {
+            ttl = std::clamp(result.ttl, min_ttl_, max_ttl_);
+            entry.addresses = std::move(result.addresses);
+        }
+
+        entry.expires = now + ttl;
+        //  ,      
+        entry.refresh_at = entry.addresses.empty() ? entry.expires : now + ttl * 4 / 5;
+        return entry.addresses;
+    }
+
+    //  :      TTL,
+    //      
+    void refresh_loop() {
+        while (true) {
+            std::vector<std::string> due;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait_for(lock, std::chrono::seconds(1), [this] { return !running_; });
+                if (!running_) break;
+
+                auto now = Clock::now();
+                for (auto it = entries_.begin(); it != entries_.end();) {
+                    Entry& entry = it->second;
+                    bool pending = waiters_.find(it->first) != waiters_.end();
+                    bool idle = now - entry.last_used > idle_limit_;
+                    if (idle && now >= entry.expires && !pending) {
+                        it = entries_.erase(it);
+                        continue;
+                    }
+                    if (!idle && now >= entry.refresh_at && !pending) {
+                        due.push_back(it->first);
+                        waiters_[it->first];
+                    }
+                    ++it;
+                }
+            }
+
+            //  ,    
+            for (const auto& host : due) {
+                begin(host);
+            }
+        }
+    }
+
+    std::unordered_map<std::string, Entry> entries_;
+    std::unordered_map<std::string, std::vector<Callback>> waiters_; // ,    
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::thread refresh_thread_;
+    bool running_ = false;
+
+    std::chrono::seconds negative_ttl_{ 30 };
+    const std::chrono::seconds transient_ttl_{ 5 };  //    DNS 
+    const std::chrono::seconds hosts_ttl_{ 60 };     //    /etc/hosts TTL 
+    const std::chrono::seconds min_ttl_{ 5 };
+    const std::chrono::seconds max_ttl_{ 3600 };
+    const std::chrono::minutes idle_limit_{ 10 };    //      
+
+    //  :  ,     
+    DnsResolver resolver_;
+};
@@ -0,0 +1,212 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <initializer_list>
+
+//  ,    
+enum class ProbeProtocol : uint8_t {
+    Icmp,
+    Http,
+    Sweep,
+    Count
+};
+
+//  ; 0 -  
+struct GovernorLimits {
+    double per_second = 0;      //  ()  
+    double burst = 0;           //   ; 0 -    
+    uint32_t max_in_flight = 0; //   
+};
+
+//     
+struct GovernorMetrics {
+    uint64_t admitted = 0;   //  
+    uint64_t throttled = 0;  //    
+    double throttled_ms = 0; //   
+    uint32_t in_flight = 0;
+    uint32_t peak_in_flight = 0;
+};
+
+//    :        
+//   ,        .
+//             ICMP
+//  :  ,      
+class ProbeGovernor {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static ProbeGovernor& instance() {
+        static ProbeGovernor governor;
+        return governor;
+    }
+
+    ProbeGovernor(const ProbeGovernor&) = delete;
+    ProbeGovernor& operator=(const ProbeGovernor&) = delete;
+
+    void set_limits(ProbeProtocol protocol, const GovernorLimits& limits) {
+        configure(budgets_[index(protocol)], limits);
+    }
+
+    //     
+    void set_total_limits(const GovernorLimits& limits) {
+        configure(total_, limits);
+    }
+
+    //      count   ,   (  1).
+    //  running , ;     ,    .
+    //       release
+    size_t acquire(ProbeProtocol protocol, size_t count, const std::atomic<bool>* running = nullptr) {
+        Budget& budget = budgets_[index(protocol)];
+        count = std::max<size_t>(count, 1);
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        Clock::time_point waiting_since{};
+        bool waited = false;
+        size_t granted;
+        while (true) {
+            auto now = Clock::now();
+            refill(budget, now);
+            refill(total_, now);
+            granted = std::min(available(budget, count), available(total_, count));
+            if (granted > 0 || (running && !running->load())) {
+                granted = std::max<size_t>(granted, 1);
+                break;
+            }
+            if (!waited) {
+                waited = true;
+                waiting_since = now;
+            }
+            //       refill_wait;    -  release
+            cv_.wait_until(lock, now + std::min(refill_wait(budget), refill_wait(total_)));
+        }
+
+        take(budget, granted);
+        take(total_, granted);
+        budget.metrics.admitted += granted;
+        if (waited) {
+            budget.metrics.throttled++;
+            budget.metrics.throttled_ms += std::chrono::duration<double, std::milli>(Clock::now() - waiting_since).count();
+        }
+        return granted;
+    }
+
+    //  ( ) ,    
+    void release(ProbeProtocol protocol, size_t count = 1) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            Budget& budget = budgets_[index(protocol)];
+            budget.metrics.in_flight -= static_cast<uint32_t>(std::min<size_t>(count, budget.metrics.in_flight));
+            total_.metrics.in_flight -= static_cast<uint32_t>(std::min<size_t>(count, total_.metrics.in_flight));
+        }
+        cv_.notify_all();
+    }
+
+    // ,       :     ,  
+    void refund(ProbeProtocol protocol, size_t count) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            Budget& budget = budgets_[index(protocol)];
+            budget.metrics.admitted -= std::min<uint64_t>(count, budget.metrics.admitted);
+            for (Budget* refunded : { &budget, &total_ }) {
+                refunded->metrics.in_flight -= static_cast<uint32_t>(std::min<size_t>(count, refunded->metrics.in_flight));
+                if (refunded->limits.per_second > 0) {
+                    refunded->tokens = std::min(refunded->limits.burst, refunded->tokens + static_cast<double>(count));
+                }
+            }
+        }
+        cv_.notify_all();
+    }
+
+    GovernorMetrics metrics(ProbeProtocol protocol) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return budgets_[index(protocol)].metrics;
+    }
+
+    //       ;  -   
+    GovernorMetrics total_metrics() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return total_.metrics;
+    }
+
+private:
+    struct Budget {
+        GovernorLimits limits;
+        double tokens = 0;
+        Clock::time_point refilled = Clock::now();
+        GovernorMetrics metrics;
+    };
+
+    //   : ICMP -     , HTTP -   
+    //   ,   -       1 .
+    //     :         ,
+    //     
+    ProbeGovernor() {
+        configure(budgets_[index(ProbeProtocol::Icmp)], { 5000, 500, 10000 });
+        configure(budgets_[index(ProbeProtocol::Http)], { 100, 20, 64 });
+        configure(budgets_[index(ProbeProtocol::Sweep)], { 10000, 1000, 10000 });
+        configure(total_, { 12000, 1200, 20000 });
+    }
+
+    static size_t index(ProbeProtocol protocol) {
+        return static_cast<size_t>(protocol);
+    }
+
+    void configure(Budget& budget, GovernorLimits limits) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (limits.per_second > 0 && limits.burst <= 0) {
+                limits.burst = std::max(1.0, limits.per_second / 10);
+            }
+            budget.limits = limits;
+            budget.tokens = limits.burst;
+            budget.refilled = Clock::now();
+        }
+        cv_.notify_all();
+    }
+
+    static void refill(Budget& budget, Clock::time_point now) {
+        if (budget.limits.per_second > 0) {
+            double elapsed = std::chrono::duration<double>(now - budget.refilled).count();
+            budget.tokens = std::min(budget.limits.burst, budget.tokens + elapsed * budget.limits.per_second);
+        }
+        budget.refilled = now;
+    }
+
+    static size_t available(const Budget& budget, size_t count) {
+        if (budget.limits.per_second > 0) {
+            count = std::min(count, static_cast<size_t>(budget.tokens));
+        }
+        if (budget.limits.max_in_flight > 0) {
+            count = std::min<size_t>(count, budget.limits.max_in_flight - std::min(budget.limits.max_in_flight, budget.metrics.in_flight));
+        }
+        return count;
+    }
+
+    static void take(Budget& budget, size_t count) {
+        if (budget.limits.per_second > 0) {
+            budget.tokens -= static_cast<double>(count);
+        }
+        budget.metrics.in_flight += static_cast<uint32_t>(count);
+        budget.metrics.peak_in_flight = std::max(budget.metrics.peak_in_flight, budget.metrics.in_flight);
+    }
+
+    //     ;     release
+    static Clock::duration refill_wait(const Budget& budget) {
+        if (budget.limits.per_second <= 0 || budget.tokens >= 1) {
+            return std::chrono::milliseconds(100);
+        }
+        double seconds = (1 - budget.tokens) / budget.limits.per_second;
+        return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds)) + std::chrono::microseconds(50);
+    }
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    Budget budgets_[static_cast<size_t>(ProbeProtocol::Count)];
+    Budget total_;
+};
@@ -15,6 +15,10 @@
 #include <future>
 #include <set>
 #include <curl/curl.h>
+#include "dns.h"
+#include "rto.h"
+#include "phase.h"
+#include "governor.h"
 
 //     
 struct ResponseData {
@@ -27,17 +31,20 @@ struct ResponseData {
     std::string error_message;
     double total_time = 0;
     long redirect_count = 0;
+    long timeout_ms = 0; //  ,      
 };
 
 //       
 struct MonitoredResource {
     std::string host;
-    int request_interval;
-    std::chrono::steady_clock::time_point last_request_time;
+    int request_interval; // 
+    std::chrono::steady_clock::time_point next_run; //   
     bool active;
     bool in_progress = false;
     int id;
     int proto;
+    RtoEstimator rto{}; //     
+    uint64_t phase = 0; //    ,  id 
 };
 
 // Callback 
@@ -59,7 +66,7 @@ class WebResourceMonitor {
 public:
     using CallbackType = std::function<void(const std::string& host, const ResponseData& response, bool success, int id, int proto)>;
 
-    WebResourceMonitor() : running_(false) {
+    WebResourceMonitor() : dns_(DnsCache::instance()), running_(false) {
         curl_global_init(CURL_GLOBAL_DEFAULT);
     }
 
@@ -68,38 +75,27 @@ public:
         curl_global_cleanup();
     }
 
-    //    
+    //    .   -   :
+    //    ,      
     bool add_address(const std::string& host, int request_interval, int proto, int id) {
-        bool should_check_immediately = false;
-
-        {
-            std::lock_guard<std::mutex> lock(resources_mutex_);
-
-            if (resources_.find(host) != resources_.end()) {
-                return false;
-            }
-
-            //       
-            MonitoredResource resource{
-                host,
-                request_interval,
-                std::chrono::steady_clock::now() - std::chrono::hours(24),
-                true,
-                false,
-                id,
-                proto
-            };
-            resources_[host] = resource;
-
-            // ,    
-            should_check_immediately = running_;
-        }
+        std::lock_guard<std::mutex> lock(resources_mutex_);
 
-        //    ,     ( )
-        if (should_check_immediately) {
-            start_immediate_check(host);
+        if (resources_.find(host) != resources_.end()) {
+            return false;
         }
 
+        auto now = std::chrono::steady_clock::now();
+        MonitoredResource resource{
+            .host = host,
+            .request_interval = request_interval,
+            .next_run = running_ ? phases_.first_run(now) : now,
+            .active = true,
+            .in_progress = false,
+            .id = id,
+            .proto = proto
+        };
+        resource.phase = PhaseSpreader::hash(static_cast<uint64_t>(id));
+        resources_[host] = resource;
         return true;
     }
 
@@ -109,6 +105,17 @@ public:
         return resources_.erase(host) > 0;
     }
 
+    //   ;        
+    void set_timeout_bounds(std::chrono::milliseconds min, std::chrono::milliseconds max) {
+        min_timeout_ms_ = static_cast<uint32_t>(std::max<long long>(min.count(), 1));
+        max_timeout_ms_ = static_cast<uint32_t>(std::max<long long>(max.count(), min_timeout_ms_));
+    }
+
+    //        
+    void set_ramp_rate(unsigned resources_per_second) {
+        phases_.set_ramp_rate(resources_per_second);
+    }
+
     //  callback 
     void register_cb(CallbackType callback) {
         std::lock_guard<std::mutex> lock(callback_mutex_);
@@ -121,8 +128,8 @@ public:
 
         running_ = true;
 
-        //       
-        check_all_hosts_immediately();
+        //         
+        schedule_first_checks();
 
         monitor_thread_ = std::thread(&WebResourceMonitor::monitor_loop, this);
     }
@@ -141,44 +148,14 @@ public:
     }
 
 private:
-    //      
-    void check_all_hosts_immediately() {
-        std::vector<std::string> hosts_to_check;
-
-        {
-            std::lock_guard<std::mutex> lock(resources_mutex_);
-            for (auto& [host, resource] : resources_) {
-                if (resource.active && !resource.in_progress) {
-                    hosts_to_check.push_back(host);
-                    resource.in_progress = true;
-                }
-            }
-        }
-
-        for (const auto& host : hosts_to_check) {
-            std::thread(&WebResourceMonitor::check_resource_async, this, host).detach();
-        }
-    }
-
-
-    //    
-    void start_immediate_check(const std::string& host) {
-        bool should_check = false;
-
-        {
-            std::lock_guard<std::mutex> lock(resources_mutex_);
-            if (auto it = resources_.find(host); it != resources_.end() && !it->second.in_progress) {
-                it->second.in_progress = true;
-                should_check = true;
+    void schedule_first_checks() {
+        std::lock_guard<std::mutex> lock(resources_mutex_);
+        auto now = std::chrono::steady_clock::now();
+        for (auto& [host, resource] : resources_) {
+            if (resource.active && !resource.in_progress) {
+                resource.next_run = phases_.first_run(now);
             }
         }
-
-        if (should_check) {
-            //     
-            std::thread([this, host]() {
-                check_resource_async(host);
-                }).detach();
-        }
     }
 
     //   
@@ -218,34 +195,60 @@ private:
             auto now = std::chrono::steady_clock::now();
 
             for (auto& [host, resource] : resources_) {
-                if (resource.active && !resource.in_progress) {
-                    auto elapsed = std::chrono::duration_cast<std::chrono::seconds>(
-                        now - resource.last_request_time);
-
-                    if (elapsed.count() >= resource.request_interval) {
-                        hosts_to_check.push_back(host);
-                        resource.in_progress = true;
-                    }
+                if (resource.active && !resource.in_progress && now >= resource.next_run) {
+                    //   -   ,     
+                    resource.next_run = phases_.next_run(resource.phase, std::chrono::seconds(resource.request_interval), now);
+                    hosts_to_check.push_back(host);
+                    resource.in_progress = true;
                 }
             }
         }
 
+        //       :    
+        // ,     ,   acquire.
+        //       
         for (const auto& host : hosts_to_check) {
-            std::thread(&WebResourceMonitor::check_resource_async, this, host).detach();
+            governor_.acquire(ProbeProtocol::Http, 1, &running_);
+            try {
+                std::thread(&WebResourceMonitor::check_resource_async, this, host).detach();
+            }
+            catch (const std::system_error& e) {
+                governor_.release(ProbeProtocol::Http);
+                std::lock_guard<std::mutex> lock(resources_mutex_);
+                if (auto it = resources_.find(host); it != resources_.end()) {
+                    it->second.in_progress = false;
+                }
+                std::cerr << "Cannot start check for " << host << ": " << e.what() << std::endl;
+            }
         }
     }
 
-    //   
+    //   ;       update
     void check_resource_async(const std::string& host) {
+        bool admitted = true;
         try {
             ResponseData response;
+            response.timeout_ms = max_timeout_ms_;
+            {
+                std::lock_guard<std::mutex> lock(resources_mutex_);
+                if (auto it = resources_.find(host); it != resources_.end()) {
+                    response.timeout_ms = it->second.rto.timeout_ms(min_timeout_ms_, max_timeout_ms_);
+                }
+            }
             bool success = fetch_website_data(host, response);
+            governor_.release(ProbeProtocol::Http);
+            admitted = false;
             int id{}, proto{};
             //   
             {
                 std::lock_guard<std::mutex> lock(resources_mutex_);
                 if (auto it = resources_.find(host); it != resources_.end()) {
-                    it->second.last_request_time = std::chrono::steady_clock::now();
+                    if (success) {
+                        it->second.rto.sample(response.total_time * 1000);
+                    }
+                    else if (response.curl_error == CURLE_OPERATION_TIMEDOUT) {
+                        it->second.rto.timeout();
+                    }
                     it->second.in_progress = false;
                     id = it->second.id;
                     proto = it->second.proto;
@@ -262,6 +265,9 @@ private:
         }
         catch (const std::exception& e) {
             //     
+            if (admitted) {
+                governor_.release(ProbeProtocol::Http);
+            }
             std::lock_guard<std::mutex> lock(resources_mutex_);
             if (auto it = resources_.find(host); it != resources_.end()) {
                 it->second.in_progress = false;
@@ -269,6 +275,9 @@ private:
             std::cerr << "Exception in check_resource_async for " << host << ": " << e.what() << std::endl;
         }
         catch (...) {
+            if (admitted) {
+                governor_.release(ProbeProtocol::Http);
+            }
             std::lock_guard<std::mutex> lock(resources_mutex_);
             if (auto it = resources_.find(host); it != resources_.end()) {
                 it->second.in_progress = false;
@@ -301,7 +310,7 @@ private:
         }
     }
 
-    //      
+    //      ;    response.timeout_ms
     bool fetch_website_data(const std::string& url, ResponseData& response) {
         CURL* curl = curl_easy_init();
         if (!curl) {
@@ -309,12 +318,22 @@ private:
             return false;
         }
 
+        //       DNS      curl
+        curl_slist* resolve = nullptr;
+        if (!make_resolve_list(url, resolve)) {
+            response.curl_error = CURLE_COULDNT_RESOLVE_HOST;
+            response.error_message = curl_easy_strerror(CURLE_COULDNT_RESOLVE_HOST);
+            curl_easy_cleanup(curl);
+            return false;
+        }
+        curl_easy_setopt(curl, CURLOPT_RESOLVE, resolve);
+
         //  
         curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
         curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
         curl_easy_setopt(curl, CURLOPT_USERAGENT, "Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36");
-        curl_easy_setopt(curl, CURLOPT_TIMEOUT, 10L);
-        curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 5L);
+        curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, response.timeout_ms);
+        curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, std::min(response.timeout_ms, 5000L));
         curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
 
         // Callback 
@@ -339,6 +358,7 @@ private:
         if (res != CURLE_OK) {
             response.error_message = curl_easy_strerror(res);
             curl_easy_cleanup(curl);
+            curl_slist_free_all(resolve);
             return false;
         }
 
@@ -355,10 +375,48 @@ private:
         }
 
         curl_easy_cleanup(curl);
+        curl_slist_free_all(resolve);
         return true;
     }
 
+    //  CURLOPT_RESOLVE "host:port:addr1,addr2"    URL.
+    // false,    ;      URL  
+    bool make_resolve_list(const std::string& url, curl_slist*& list) {
+        list = nullptr;
+        CURLU* parsed = curl_url();
+        if (!parsed) return true;
+
+        char* host = nullptr;
+        char* port = nullptr;
+        bool result = true;
+        if (curl_url_set(parsed, CURLUPART_URL, url.c_str(), CURLU_GUESS_SCHEME) == CURLUE_OK &&
+            curl_url_get(parsed, CURLUPART_HOST, &host, 0) == CURLUE_OK &&
+            curl_url_get(parsed, CURLUPART_PORT, &port, CURLU_DEFAULT_PORT) == CURLUE_OK &&
+            host[0] != '[') {
+            auto addresses = dns_.resolve(host);
+            if (addresses.empty()) {
+                result = false;
+            }
+            else if (addresses.size() != 1 || addresses[0].address != host) {
+                std::string entry = std::string(host) + ":" + port + ":";
+                for (size_t i = 0; i < addresses.size(); ++i) {
+                    if (i) entry += ",";
+                    entry += addresses[i].family == AF_INET6 ? "[" + addresses[i].address + "]" : addresses[i].address;
+                }
+                list = curl_slist_append(nullptr, entry.c_str());
+            }
+        }
+        curl_free(host);
+        curl_free(port);
+        curl_url_cleanup(parsed);
+        return result;
+    }
+
 private:
+    DnsCache& dns_; //   DNS,   
+    PhaseSpreader phases_;
+    ProbeGovernor& governor_ = ProbeGovernor::instance();
+
     std::unordered_map<std::string, MonitoredResource> resources_;
     std::mutex resources_mutex_;
 
@@ -366,6 +424,8 @@ private:
     std::mutex callback_mutex_;
 
     std::atomic<bool> running_;
+    std::atomic<uint32_t> min_timeout_ms_{ 1000 };
+    std::atomic<uint32_t> max_timeout_ms_{ 10000 }; //   CURLOPT_TIMEOUT
     std::thread monitor_thread_;
     std::condition_variable cv_;
 };
@@ -15,43 +15,408 @@
 #include <queue>
 #include <map>
 #include <functional>
+#include <array>
+#include <cmath>
+#include <iterator>
 #include "icmplib.h"
+#include "address.h"
+#include "dns.h"
+#include "timing_wheel.h"
+#include "work_stealing_deque.h"
+#include "completion_queue.h"
+#include "rto.h"
+#include "phase.h"
+#include "governor.h"
+
+//   -  ,   .
+// min/avg/max/stddev/jitter     
+struct SeriesSummary {
+    uint16_t sent = 0;          //     (,   )
+    uint16_t received = 0;      //  
+    double first_ms = 0;        //   ,    -    ( Delay)
+    double min_ms = 0;
+    double avg_ms = 0;
+    double max_ms = 0;
+    double stddev_ms = 0;
+    double jitter_ms = 0;       //      
+    double loss_percent = 0;
+    icmplib::PingResponseType status = icmplib::PingResponseType::Failure; // Success     
+    uint8_t ttl = 0;            // TTL  
+    uint32_t timeout_ms = 0;    //    ,    RTT 
+};
+
+//   ,   mtr:        
+struct HopSummary {
+    uint8_t hop = 0;
+    std::string address;  //   ,  -     
+    double last_ms = 0;   //   
+    SeriesSummary stats;  //   ; TIME_EXCEEDED    
+};
+
+//      ,     A/AAAA
+struct AddressSummary {
+    std::string address;
+    SeriesSummary stats;
+};
+
+//    
+enum class AddressMode : uint8_t {
+    First, //    DNS ( IPv4)
+    All    //   :      -   anycast
+};
+
+//   .     max_count ,
+//      ,     
+struct SeriesPolicy {
+    enum class Mode : uint8_t {
+        Fixed,        //  max_count 
+        FirstSuccess, //    
+        Successes,    //  successes   (     )
+        LossBound     //       loss_margin
+    };
+
+    Mode mode = Mode::Fixed;
+    uint16_t max_count = 7;   //      (  16)
+    uint16_t successes = 1;   //  Mode::Successes
+    uint16_t min_count = 3;   //  Mode::LossBound:    
+    double loss_margin = 0.2; //  Mode::LossBound:      (0..1)
+    double z = 1.96;          //   , 1.96 - 95%
+
+    static SeriesPolicy fixed(uint16_t count = 7) {
+        return { Mode::Fixed, count };
+    }
+
+    static SeriesPolicy first_success(uint16_t max_count = 7) {
+        return { Mode::FirstSuccess, max_count };
+    }
+
+    static SeriesPolicy until_successes(uint16_t successes, uint16_t max_count = 7) {
+        return { Mode::Successes, max_count, successes };
+    }
+
+    static SeriesPolicy loss_bound(double margin = 0.2, uint16_t max_count = 16, double z = 1.96) {
+        SeriesPolicy policy{ Mode::LossBound, max_count };
+        policy.loss_margin = margin;
+        policy.z = z;
+        return policy;
+    }
+
+    // count -  , received -   
+    bool satisfied(uint32_t count, uint32_t received) const {
+        if (count >= max_count) {
+            return true;
+        }
+        switch (mode) {
+        case Mode::FirstSuccess:
+            return received > 0;
+        case Mode::Successes:
+            return received >= successes || count - received > static_cast<uint32_t>(max_count - std::min(successes, max_count));
+        case Mode::LossBound: {
+            if (count < min_count) {
+                return false;
+            }
+            //  :         0% 
+            double n = count;
+            double loss = (count - received) / n;
+            double z2 = z * z;
+            double half_width = z * std::sqrt(loss * (1 - loss) / n + z2 / (4 * n * n)) / (1 + z2 / n);
+            return half_width <= loss_margin;
+        }
+        default:
+            return false;
+        }
+    }
+
+    bool operator==(const SeriesPolicy&) const = default;
+};
 
 class AsyncPinger {
 private:
-    struct PingTask {
+    struct PathTrace;
+    struct FanOut;
+
+    static constexpr size_t max_series_count = 16; //   
+    static constexpr size_t max_fanout = 32;       //       All
+
+    //       ,    :
+    //      ,   .   
+    // ; ,     ,     .
+    //       ,        
+    //  ,   -      late.    
+    //  - ,      
+    struct SeriesBuffer {
+        static constexpr uint32_t closed_flag = 1u << 31;
+
+        struct Sample {
+            double delay = 0;
+            icmplib::PingResponseType response = icmplib::PingResponseType::Failure;
+            uint8_t ttl = 0;
+            uint32_t timeout_ms = 0;
+        };
+
+        std::array<Sample, max_series_count> samples;
+        std::atomic<uint32_t> claimed{ 0 };   //  , closed_flag -    
+        std::atomic<uint32_t> finished{ 0 };  //  
+        std::atomic<uint32_t> succeeded{ 0 }; //   
+        std::atomic<uint32_t> late{ 0 };      // ,    
+
+        bool closed() const {
+            return claimed.load(std::memory_order_acquire) & closed_flag;
+        }
+
+        //      ,   ; false -   
+        bool close(uint32_t& total) {
+            uint32_t previous = claimed.fetch_or(closed_flag, std::memory_order_acq_rel);
+            total = previous & ~closed_flag;
+            return !(previous & closed_flag);
+        }
+
+        //      
+        bool drained(uint32_t sent) const {
+            return finished.load(std::memory_order_acquire) + late.load(std::memory_order_acquire) >= sent;
+        }
+
+        void reset() {
+            finished.store(0, std::memory_order_relaxed);
+            succeeded.store(0, std::memory_order_relaxed);
+            late.store(0, std::memory_order_relaxed);
+            claimed.store(0, std::memory_order_release);
+        }
+    };
+
+    //  ,       
+    struct PingTarget {
+        explicit PingTarget(const std::string& address, const SeriesPolicy& policy = SeriesPolicy{}) : address(address), policy(policy) {}
+
         std::string address;
-        std::chrono::minutes interval;
-        std::chrono::steady_clock::time_point next_ping_time;
-        int pings_remaining = 0; //      
+        const SeriesPolicy policy;
+        std::atomic<bool> active{ true }; //   ,   
+        std::shared_ptr<PathTrace> trace; //     
+        std::shared_ptr<FanOut> fanout;   //       AddressMode::All
+        SeriesBuffer series;              //      All
+        RtoEstimator rto; //  -   RTT
+    };
+
+    //     ,       
+    struct PingTask {
+        std::shared_ptr<PingTarget> target;
+        std::chrono::milliseconds interval{};
+        std::chrono::steady_clock::time_point series_start; //   
+        TimingWheel<uint32_t>::Handle timer = TimingWheel<uint32_t>::invalid_handle;
+        std::chrono::steady_clock::time_point due{}; //    
+        uint32_t pings_sent = 0; //     
+        uint64_t phase = 0;      //     
         bool is_in_series = false; // ,     
+    };
+
+    //  ;     ,  
+    struct ProbeJob {
+        std::shared_ptr<PingTarget> target;
+        std::chrono::steady_clock::time_point send_at{}; //    SO_TXTIME,  - 
+    };
+
+    // ,      ;    
+    struct ResolvedJob {
+        std::shared_ptr<PingTarget> target;
+        std::vector<ResolvedAddress> addresses;
+    };
 
-        bool operator<(const PingTask& other) const {
-            return next_ping_time > other.next_ping_time;
+    //        ( )
+    struct SeriesStats {
+        void add(icmplib::PingResponseType response, double delay, uint8_t reply_ttl) {
+            sent++;
+            if (response != icmplib::PingResponseType::Success) {
+                if (received == 0) {
+                    status = response;
+                }
+                if (sent == 1) {
+                    first = delay;
+                }
+                return;
+            }
+
+            received++;
+            if (received == 1) {
+                first = delay;
+            }
+            status = icmplib::PingResponseType::Success;
+            ttl = reply_ttl;
+            if (received == 1) {
+                min = max = delay;
+            }
+            else {
+                min = std::min(min, delay);
+                max = std::max(max, delay);
+                jitter_sum += std::abs(delay - last_delay);
+            }
+            last_delay = delay;
+
+            double delta = delay - mean;
+            mean += delta / received;
+            m2 += delta * (delay - mean);
+        }
+
+        SeriesSummary summary() const {
+            SeriesSummary summary;
+            summary.sent = sent;
+            summary.received = received;
+            summary.status = status;
+            summary.ttl = ttl;
+            summary.first_ms = first;
+            if (sent > 0) {
+                summary.loss_percent = 100.0 * (sent - received) / sent;
+            }
+            if (received > 0) {
+                summary.min_ms = min;
+                summary.avg_ms = mean;
+                summary.max_ms = max;
+            }
+            if (received > 1) {
+                summary.stddev_ms = std::sqrt(m2 / (received - 1));
+                summary.jitter_ms = jitter_sum / (received - 1);
+            }
+            return summary;
+        }
+
+        uint16_t sent = 0;
+        uint16_t received = 0;
+        double first = 0;
+        double min = 0;
+        double max = 0;
+        double mean = 0;
+        double m2 = 0;         //     
+        double last_delay = 0;
+        double jitter_sum = 0;
+        icmplib::PingResponseType status = icmplib::PingResponseType::Failure;
+        uint8_t ttl = 0;
+    };
+
+    //   ,    
+    struct PathTrace {
+        struct Hop {
+            std::string address;
+            double last_ms = 0;
+            SeriesStats stats;
+        };
+
+        explicit PathTrace(uint8_t max_hops) : max_hops(max_hops), hops(max_hops) {}
+
+        const uint8_t max_hops;
+        std::mutex mutex;
+        std::vector<Hop> hops;
+        uint8_t destination = 0; // ,     ; 0 -   
+    };
+
+    //  :    TTL  ,  ,
+    //      
+    struct TraceRound {
+        explicit TraceRound(size_t hops) : results(hops), remaining(hops) {}
+
+        std::vector<icmplib::PingResult> results;
+        std::atomic<size_t> remaining;
+    };
+
+    //    .    -   -    ;
+    //    (max_count    ),    
+    struct FanOut {
+        struct Member {
+            std::string address;
+            SeriesStats stats{};
+            RtoEstimator rto{};     //     RTT
+            uint32_t timeout_ms = 0; //   
+        };
+
+        std::mutex mutex;
+        std::vector<Member> members;
+        SeriesStats total; //      
+        uint32_t rounds = 0;
+
+        Member& member(const std::string& address) {
+            for (auto& member : members) {
+                if (member.address == address) {
+                    return member;
+                }
+            }
+            members.push_back(Member{ .address = address });
+            return members.back();
         }
     };
 
+    struct FanOutRound {
+        explicit FanOutRound(size_t count) : addresses(count), results(count), timeouts(count), remaining(count) {}
+
+        std::vector<std::string> addresses;
+        std::vector<icmplib::PingResult> results;
+        std::vector<uint32_t> timeouts;
+        std::atomic<size_t> remaining;
+    };
+
+    //     ,    
+    struct Completion {
+        std::string address;
+        SeriesSummary summary;
+        std::vector<HopSummary> hops;
+        std::vector<AddressSummary> addresses; //    AddressMode::All
+        bool trace = false;
+    };
+
+    //  : ,      
+    struct TaskLocation {
+        size_t thread;
+        uint32_t slot;
+        std::shared_ptr<PingTarget> target;
+    };
+
+    //  ICMP :        
+    icmplib::ICMPEngine& engine;
+
+    //   DNS;    ,    
+    DnsCache& dns;
+
     std::vector<std::thread> workers;
     std::vector<std::unique_ptr<std::mutex>> mutexes;
     std::vector<std::unique_ptr<std::condition_variable>> cvs;
-    std::vector<std::priority_queue<PingTask>> task_queues;
+    std::vector<TimingWheel<uint32_t>> wheels;
+    std::vector<std::vector<PingTask>> tasks;
+    std::vector<std::vector<uint32_t>> free_slots;
+    std::vector<std::unique_ptr<WorkStealingDeque<ProbeJob*>>> deques; //    
+    std::vector<std::vector<ProbeJob*>> spare_jobs; //     ,    
+    static constexpr size_t max_spare_jobs = 4096;
+    std::vector<std::vector<ResolvedJob>> resolved; //     ,   
+    std::atomic<size_t> next_thread{ 0 };
     std::atomic<bool> running{ false };
-    const int ping_series_count = 7; //    
+    const int trace_window = 100; //      
+    static constexpr std::chrono::milliseconds min_interval{ 1 }; //   
+    std::atomic<long long> series_spacing_ms{ 100 }; //      
+    std::atomic<uint32_t> min_timeout_ms{ 50 }; //   -
+    std::atomic<uint32_t> max_timeout_ms{ ICMPLIB_TIMEOUT_1S };
+    PhaseSpreader phases; //         
+    std::atomic<long long> pacing_lead_us{ 0 }; //        
+    std::atomic<int> in_flight{ 0 }; // -,    
+    ProbeGovernor& governor = ProbeGovernor::instance(); //        
 
-    //   ,      
+    //   ,        
     std::mutex address_map_mutex;
-    std::unordered_map<std::string, size_t> address_to_thread;
+    std::unordered_map<std::string, TaskLocation> address_to_thread;
+    std::unordered_map<std::string, TaskLocation> trace_to_thread;
 
     //      
     std::mutex callback_mutex;
-    std::function<void(std::string, std::vector<icmplib::PingResult>)> callback;
+    std::function<void(std::string, const SeriesSummary&)> callback;
+    std::function<void(std::string, const std::vector<HopSummary>&)> trace_callback;
+    std::function<void(std::string, const std::vector<AddressSummary>&)> address_callback;
 
-    //        
-    std::mutex results_mutex;
-    std::unordered_map<std::string, std::vector<icmplib::PingResult>> series_results;
+    //          .  ;
+    //      ,    (  ) 
+    //   ,     
+    CompletionQueue<Completion> completions{ 4096 };
+    std::atomic<uint32_t> completions_pushed{ 0 }; //     
+    std::atomic<uint64_t> completions_dropped{ 0 };
+    std::atomic<bool> delivering{ false };
+    std::thread delivery;
 
 public:
-    AsyncPinger() {
+    AsyncPinger() : engine(icmplib::ICMPEngine::Instance()), dns(DnsCache::instance()) {
         unsigned int num_threads = std::thread::hardware_concurrency();
         if (num_threads == 0) {
             num_threads = 4;
@@ -60,10 +425,17 @@ public:
         for (unsigned int i = 0; i < num_threads; ++i) {
             mutexes.emplace_back(std::make_unique<std::mutex>());
             cvs.emplace_back(std::make_unique<std::condition_variable>());
-            task_queues.emplace_back();
+            wheels.emplace_back();
+            tasks.emplace_back();
+            free_slots.emplace_back();
+            deques.emplace_back(std::make_unique<WorkStealingDeque<ProbeJob*>>());
+            spare_jobs.emplace_back();
+            resolved.emplace_back();
         }
 
         running = true;
+        delivering = true;
+        delivery = std::thread(&AsyncPinger::delivery_thread, this);
 
         for (unsigned int i = 0; i < num_threads; ++i) {
             workers.emplace_back(&AsyncPinger::worker_thread, this, i);
@@ -77,76 +449,120 @@ public:
     }
 
     //   
-    void set_callback(std::function<void(std::string, std::vector<icmplib::PingResult>)> func) {
+    void set_callback(std::function<void(std::string, const SeriesSummary&)> func) {
         std::lock_guard<std::mutex> lock(callback_mutex);
         callback = std::move(func);
         std::cout << "Callback set successfully" << std::endl;
     }
 
-    void add_address(const std::string& address, std::chrono::minutes interval = std::chrono::minutes(5)) {
-        static size_t next_thread = 0;
-        size_t thread_index = next_thread;
-        next_thread = (next_thread + 1) % workers.size();
-
-        auto now = std::chrono::steady_clock::now();
-        PingTask task{ address, interval, now, ping_series_count, true };
-
-        {
-            std::lock_guard<std::mutex> lock(*mutexes[thread_index]);
-            task_queues[thread_index].push(task);
+    //   -   (     )
+    void set_series_spacing(std::chrono::milliseconds spacing) {
+        series_spacing_ms = spacing.count();
+    }
 
-            // ,     
-            std::lock_guard<std::mutex> map_lock(address_map_mutex);
-            address_to_thread[address] = thread_index;
+    //        ;    
+    void set_ramp_rate(unsigned targets_per_second) {
+        phases.set_ramp_rate(targets_per_second);
+    }
 
-            std::cout << "Added address: " << address << " to thread " << thread_index
-                << " with interval: " << interval.count() << "ms" << std::endl;
+    //  :    lead   ,     
+    //  SO_TXTIME,         .
+    //          , 
+    // "tc qdisc replace dev eth0 root fq" ( "dev lo"    );  fq  
+    // flow_limit,   lead   100 .    SO_TXTIME,  false;
+    //    ,    ,    .
+    // lead = 0  
+    bool set_precise_pacing(std::chrono::microseconds lead) {
+        if (lead.count() <= 0) {
+            pacing_lead_us = 0;
+            engine.SetTxTime(false);
+            return true;
         }
-        cvs[thread_index]->notify_one();
+        if (!engine.SetTxTime(true)) {
+            pacing_lead_us = 0;
+            return false;
+        }
+        pacing_lead_us = lead.count();
+        return true;
     }
 
-    void remove_address(const std::string& address) {
-        size_t thread_index;
-        bool found = false;
+    //  -   RTT  ( RTO  TCP)     ;
+    //    ,   
+    void set_timeout_bounds(std::chrono::milliseconds min, std::chrono::milliseconds max) {
+        min_timeout_ms = static_cast<uint32_t>(std::max<long long>(min.count(), 1));
+        max_timeout_ms = static_cast<uint32_t>(std::max<long long>(max.count(), min_timeout_ms));
+    }
+
+    //    -  ,    (, 10   5 ).
+    // policy ,   ;   -  7 .
+    //   AddressMode::All      ,     -
+    //    (set_address_callback)
+    void add_address(const std::string& address, std::chrono::milliseconds interval = std::chrono::minutes(5), SeriesPolicy policy = SeriesPolicy{},
+        AddressMode mode = AddressMode::First) {
+        policy.max_count = std::clamp<uint16_t>(policy.max_count, 1, max_series_count);
 
+        //             ,
+        //    (  )
+        bool replace = false;
         {
-            //      
             std::lock_guard<std::mutex> map_lock(address_map_mutex);
             auto it = address_to_thread.find(address);
-            if (it != address_to_thread.end()) {
-                thread_index = it->second;
-                found = true;
-                address_to_thread.erase(it);
-            }
+            replace = it != address_to_thread.end() &&
+                (!(it->second.target->policy == policy) || (it->second.target->fanout != nullptr) != (mode == AddressMode::All));
         }
+        if (replace) {
+            remove_target(address_to_thread, address);
+        }
+        else if (update_interval(address_to_thread, address, interval)) {
+            return;
+        }
+        auto target = std::make_shared<PingTarget>(address, policy);
+        if (mode == AddressMode::All) {
+            target->fanout = std::make_shared<FanOut>();
+        }
+        add_target(address_to_thread, target, interval);
+    }
 
-        if (found) {
-            //    
-            std::lock_guard<std::mutex> lock(*mutexes[thread_index]);
+    void set_address_callback(std::function<void(std::string, const std::vector<AddressSummary>&)> func) {
+        std::lock_guard<std::mutex> lock(callback_mutex);
+        address_callback = std::move(func);
+    }
 
-            std::priority_queue<PingTask> new_queue;
-            auto temp_queue = task_queues[thread_index];
+    void remove_address(const std::string& address) {
+        //      
+        remove_target(address_to_thread, address);
+    }
 
-            while (!temp_queue.empty()) {
-                auto task = temp_queue.top();
-                temp_queue.pop();
+    //     ;   ,
+    //        
+    bool update_interval(const std::string& address, std::chrono::milliseconds interval) {
+        return update_interval(address_to_thread, address, interval);
+    }
 
-                if (task.address != address) {
-                    new_queue.push(task);
-                }
-            }
+    //     mtr.    ,     -
+    //    -   TTL  1  max_hops ,     .
+    //        
+    void add_trace(const std::string& address, std::chrono::milliseconds interval = std::chrono::minutes(5), uint8_t max_hops = 30) {
+        if (update_interval(trace_to_thread, address, interval)) {
+            return;
+        }
+        auto target = std::make_shared<PingTarget>(address);
+        target->trace = std::make_shared<PathTrace>(std::max<uint8_t>(max_hops, 1));
+        add_target(trace_to_thread, target, interval);
+    }
 
-            task_queues[thread_index] = std::move(new_queue);
+    void remove_trace(const std::string& address) {
+        remove_target(trace_to_thread, address);
+    }
 
-            //   
-            std::lock_guard<std::mutex> results_lock(results_mutex);
-            series_results.erase(address);
+    void set_trace_callback(std::function<void(std::string, const std::vector<HopSummary>&)> func) {
+        std::lock_guard<std::mutex> lock(callback_mutex);
+        trace_callback = std::move(func);
+    }
 
-            std::cout << "Removed address: " << address << " from thread " << thread_index << std::endl;
-        }
-        else {
-            std::cout << "Address " << address << " not found in any thread" << std::endl;
-        }
+    //     -   
+    uint64_t dropped_completions() const {
+        return completions_dropped.load(std::memory_order_relaxed);
     }
 
     void update() {
@@ -158,9 +574,6 @@ public:
     void stop() {
         running = false;
 
-        //      
-        flush_all_results();
-
         for (auto& cv : cvs) {
             cv->notify_all();
         }
@@ -171,75 +584,649 @@ public:
             }
         }
 
+        // ,    ,   
+        for (size_t i = 0; i < resolved.size(); ++i) {
+            std::lock_guard<std::mutex> lock(*mutexes[i]);
+            in_flight -= static_cast<int>(resolved[i].size());
+            resolved[i].clear();
+        }
+
+        //   ( )    
+        while (in_flight > 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+
+        //      
+        flush_all_results();
+
+        //        
+        delivering = false;
+        completions_pushed.fetch_add(1, std::memory_order_release);
+        completions_pushed.notify_one();
+        if (delivery.joinable()) {
+            delivery.join();
+        }
+
         workers.clear();
+
+        // ,      
+        ProbeJob* job;
+        for (auto& deque : deques) {
+            while (deque->pop(job)) {
+                delete job;
+            }
+        }
+        deques.clear();
+        for (auto& spare : spare_jobs) {
+            for (ProbeJob* spare_job : spare) {
+                delete spare_job;
+            }
+        }
+        spare_jobs.clear();
+        resolved.clear();
         mutexes.clear();
         cvs.clear();
-        task_queues.clear();
+        wheels.clear();
+        tasks.clear();
+        free_slots.clear();
         std::cout << "All worker threads stopped" << std::endl;
     }
 
 private:
-    void ping_host(std::string address) {
-        icmplib::PingResult result;
-        std::string resolved;
+    //        ,       
+    void add_target(std::unordered_map<std::string, TaskLocation>& targets, const std::shared_ptr<PingTarget>& target, std::chrono::milliseconds interval) {
+        const std::string& address = target->address;
+        interval = std::max(interval, min_interval);
+
+        //    ,     
+        size_t thread_index = next_thread++ % workers.size();
+
+        auto now = std::chrono::steady_clock::now();
+
+        {
+            std::lock_guard<std::mutex> lock(*mutexes[thread_index]);
+            uint32_t slot;
+            if (!free_slots[thread_index].empty()) {
+                slot = free_slots[thread_index].back();
+                free_slots[thread_index].pop_back();
+            }
+            else {
+                slot = static_cast<uint32_t>(tasks[thread_index].size());
+                tasks[thread_index].emplace_back();
+            }
+
+            PingTask& task = tasks[thread_index][slot];
+            task = PingTask{ .target = target, .interval = interval, .series_start = now };
+            task.phase = PhaseSpreader::hash(address);
+            schedule_task(thread_index, slot, task, phases.first_run(now), pacing_lead());
+
+            // ,       
+            std::lock_guard<std::mutex> map_lock(address_map_mutex);
+            targets[address] = TaskLocation{ thread_index, slot, task.target };
+
+            std::cout << (target->trace ? "Added trace: " : "Added address: ") << address << " to thread " << thread_index
+                << " with interval: " << interval.count() << "ms" << std::endl;
+        }
+        cvs[thread_index]->notify_one();
+    }
+
+    bool remove_target(std::unordered_map<std::string, TaskLocation>& targets, const std::string& address) {
+        TaskLocation location{};
+        bool found = false;
+
+        {
+            //      
+            std::lock_guard<std::mutex> map_lock(address_map_mutex);
+            auto it = targets.find(address);
+            if (it != targets.end()) {
+                location = it->second;
+                found = true;
+                targets.erase(it);
+            }
+        }
+
+        if (found) {
+            size_t thread_index = location.thread;
+
+            //        
+            location.target->active = false;
+
+            //          O(1)
+            std::lock_guard<std::mutex> lock(*mutexes[thread_index]);
+            PingTask& task = tasks[thread_index][location.slot];
+            wheels[thread_index].cancel(task.timer);
+            task = PingTask{};
+            free_slots[thread_index].push_back(location.slot);
+
+            std::cout << "Removed address: " << address << " from thread " << thread_index << std::endl;
+        }
+        else {
+            std::cout << "Address " << address << " not found in any thread" << std::endl;
+        }
+        return found;
+    }
+
+    bool update_interval(std::unordered_map<std::string, TaskLocation>& targets, const std::string& address, std::chrono::milliseconds interval) {
+        interval = std::max(interval, min_interval);
+        TaskLocation location{};
+        {
+            std::lock_guard<std::mutex> map_lock(address_map_mutex);
+            auto it = targets.find(address);
+            if (it == targets.end()) {
+                return false;
+            }
+            location = it->second;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(*mutexes[location.thread]);
+            PingTask& task = tasks[location.thread][location.slot];
+            if (task.target != location.target) {
+                return false;
+            }
+            task.interval = interval;
+            //         ,   
+            if (!task.is_in_series && task.pings_sent > 0 && wheels[location.thread].cancel(task.timer)) {
+                schedule_task(location.thread, location.slot, task, phases.next_run(task.phase, interval, task.series_start), pacing_lead());
+            }
+        }
+        cvs[location.thread]->notify_one();
+        return true;
+    }
+
+    //  -  ;     ,   .
+    //      DNS,       ,
+    //   DNS      .  
+    //     :    submit  
+    //    
+    void ping_host(size_t thread_index, const std::shared_ptr<PingTarget>& ping_target, std::vector<icmplib::ICMPEngine::Probe>& batch) {
+        std::vector<ResolvedAddress> addresses;
+        if (dns.cached(ping_target->address, addresses)) {
+            queue_probe(ping_target, addresses, batch);
+            return;
+        }
+
+        in_flight++;
+        dns.resolve_async(ping_target->address, [this, ping_target, thread_index](const std::vector<ResolvedAddress>& addresses) {
+            {
+                std::lock_guard<std::mutex> lock(*mutexes[thread_index]);
+                if (running) {
+                    //   :    stop   
+                    resolved[thread_index].push_back({ ping_target, addresses });
+                    cvs[thread_index]->notify_one();
+                    return;
+                }
+            }
+            in_flight--;
+        });
+    }
+
+    //  ,       
+    void submit_resolved(size_t thread_index, std::vector<ResolvedJob>& jobs, std::vector<icmplib::ICMPEngine::Probe>& batch) {
+        {
+            std::lock_guard<std::mutex> lock(*mutexes[thread_index]);
+            jobs.swap(resolved[thread_index]);
+        }
+        for (const auto& job : jobs) {
+            queue_probe(job.target, job.addresses, batch);
+            in_flight--;
+        }
+        jobs.clear();
+        if (!batch.empty()) {
+            submit(batch);
+        }
+    }
+
+    //   ,   ;  .
+    //     ,       .
+    // credit - ,  :   
+    void submit(std::vector<icmplib::ICMPEngine::Probe>& batch, size_t& credit) {
+        size_t sent = 0;
+        while (sent < batch.size()) {
+            size_t granted = std::min(credit, batch.size() - sent);
+            credit -= granted;
+            if (granted == 0) {
+                granted = governor.acquire(ProbeProtocol::Icmp, batch.size() - sent, &running);
+            }
+            if (sent == 0 && granted == batch.size()) {
+                engine.SubmitBatch(batch);
+                break;
+            }
+            std::vector<icmplib::ICMPEngine::Probe> part(std::make_move_iterator(batch.begin() + sent), std::make_move_iterator(batch.begin() + sent + granted));
+            engine.SubmitBatch(part);
+            sent += granted;
+        }
+        batch.clear();
+    }
+
+    void submit(std::vector<icmplib::ICMPEngine::Probe>& batch) {
+        size_t credit = 0;
+        submit(batch, credit);
+    }
+
+    static bool make_address(const ResolvedAddress& resolved, icmplib::IPAddress& target) {
+        ParsedAddress parsed = classify_address(resolved.address);
+        if (!parsed.is_literal()) {
+            return false;
+        }
+        sockaddr_storage storage;
+        socklen_t length = parsed.to_sockaddr(storage);
+        target = icmplib::IPAddress(reinterpret_cast<const sockaddr*>(&storage), length);
+        return true;
+    }
+
+    void queue_probe(const std::shared_ptr<PingTarget>& ping_target, const std::vector<ResolvedAddress>& addresses, std::vector<icmplib::ICMPEngine::Probe>& batch) {
+        const std::string& address = ping_target->address;
+        if (ping_target->fanout) {
+            queue_fanout_round(ping_target, addresses, batch);
+            return;
+        }
+
+        icmplib::IPAddress target;
         try {
-            if (!icmplib::IPAddress::IsCorrect(address, icmplib::IPAddress::Type::Unknown)) {
-                resolved = address;
+            if (addresses.empty()) {
+                throw std::runtime_error("Cannot resolve host");
+            }
+            if (!make_address(addresses.front(), target)) {
+                throw std::runtime_error("Incorrect resolved address");
             }
-            
-            result = icmplib::Ping(resolved.empty() ? address : resolved, ICMPLIB_TIMEOUT_1S);
-            //std::cout << "Pinged " << address << " - response: " << static_cast<int>(result.response) << std::endl;
-            
         }
         catch (const std::exception& e) {
             std::cerr << "Ping error for " << address << ": " << e.what() << std::endl;
-            result.response = icmplib::PingResponseType::Failure;
+            if (ping_target->trace) {
+                fail_trace_round(ping_target);
+            }
+            else {
+                icmplib::PingResult result{ icmplib::PingResponseType::Failure, 0, icmplib::IPAddress(), 0, 0 };
+                on_ping_result(ping_target, result, 0);
+            }
+            return;
         }
-        catch (...) {
-            std::cerr << "Unknown ping error for " << address << std::endl;
-            result.response = icmplib::PingResponseType::Failure;
+
+        if (ping_target->trace) {
+            queue_trace_round(ping_target, target, batch);
+            return;
         }
 
-        //     
-        add_result_to_series(address, result);
+        //     : TIME_EXCEEDED  
+        //      RTT,   
+        unsigned timeout = ping_target->rto.timeout_ms(min_timeout_ms, max_timeout_ms);
+        in_flight++;
+        batch.push_back({ std::move(target), [this, ping_target, timeout](const icmplib::PingResult& result) {
+            on_ping_result(ping_target, result, timeout);
+            governor.release(ProbeProtocol::Icmp);
+            in_flight--;
+        }, timeout });
     }
 
-    void add_result_to_series(const std::string& address, const icmplib::PingResult& result) {
-        std::lock_guard<std::mutex> lock(results_mutex);
-        series_results[address].push_back(result);
+    //    :    ,    ,
+    //        
+    void queue_fanout_round(const std::shared_ptr<PingTarget>& ping_target, const std::vector<ResolvedAddress>& addresses, std::vector<icmplib::ICMPEngine::Probe>& batch) {
+        FanOut& fanout = *ping_target->fanout;
+        std::vector<icmplib::IPAddress> targets;
+        auto round = std::make_shared<FanOutRound>(0);
+        for (const auto& resolved : addresses) {
+            icmplib::IPAddress target;
+            if (targets.size() < max_fanout && make_address(resolved, target)) {
+                targets.push_back(target);
+                round->addresses.push_back(resolved.address);
+            }
+        }
+
+        size_t count = targets.size();
+        if (count == 0) {
+            //    -       
+            std::cerr << "Ping error for " << ping_target->address << ": Cannot resolve host" << std::endl;
+            on_fanout_round(ping_target, *round);
+            return;
+        }
+
+        round->results.resize(count);
+        round->timeouts.resize(count);
+        round->remaining = count;
+        {
+            std::lock_guard<std::mutex> lock(fanout.mutex);
+            for (size_t i = 0; i < count; ++i) {
+                round->timeouts[i] = fanout.member(round->addresses[i]).rto.timeout_ms(min_timeout_ms, max_timeout_ms);
+            }
+        }
+        for (size_t i = 0; i < count; ++i) {
+            in_flight++;
+            batch.push_back({ targets[i], [this, ping_target, round, i](const icmplib::PingResult& result) {
+                round->results[i] = result;
+                if (--round->remaining == 0) {
+                    on_fanout_round(ping_target, *round);
+                }
+                governor.release(ProbeProtocol::Icmp);
+                in_flight--;
+            }, round->timeouts[i] });
+        }
     }
 
-    void send_series_results(const std::string& address) {
-        std::vector<icmplib::PingResult> results;
+    void on_fanout_round(const std::shared_ptr<PingTarget>& target, const FanOutRound& round) {
+        if (!target->active) {
+            return;
+        }
+
+        FanOut& fanout = *target->fanout;
+        Completion completion;
         {
-            std::lock_guard<std::mutex> lock(results_mutex);
-            if (series_results.find(address) != series_results.end()) {
-                results = std::move(series_results[address]);
-                series_results.erase(address);
+            std::lock_guard<std::mutex> lock(fanout.mutex);
+            if (round.addresses.empty()) {
+                fanout.total.add(icmplib::PingResponseType::Failure, 0, 0);
+            }
+            for (size_t i = 0; i < round.addresses.size(); ++i) {
+                const icmplib::PingResult& result = round.results[i];
+                FanOut::Member& member = fanout.member(round.addresses[i]);
+                if (result.response == icmplib::PingResponseType::Success) {
+                    member.rto.sample(result.delay);
+                }
+                else if (result.response == icmplib::PingResponseType::Timeout) {
+                    member.rto.timeout();
+                }
+                member.timeout_ms = round.timeouts[i];
+                member.stats.add(result.response, result.delay, result.ttl);
+                fanout.total.add(result.response, result.delay, result.ttl);
+            }
+            if (++fanout.rounds < target->policy.max_count) {
+                return;
+            }
+            completion = take_fanout_series(fanout);
+        }
+        completion.address = target->address;
+        push_completion(std::move(completion));
+    }
+
+    //      ; ,     , .
+    //    FanOut
+    static Completion take_fanout_series(FanOut& fanout) {
+        Completion completion;
+        completion.summary = fanout.total.summary();
+        std::vector<FanOut::Member> members;
+        for (auto& member : fanout.members) {
+            if (member.stats.sent == 0) {
+                continue;
+            }
+            AddressSummary summary{ member.address, member.stats.summary() };
+            summary.stats.timeout_ms = member.timeout_ms;
+            completion.summary.timeout_ms = std::max(completion.summary.timeout_ms, member.timeout_ms);
+            completion.addresses.push_back(std::move(summary));
+            member.stats = SeriesStats{};
+            members.push_back(std::move(member));
+        }
+        fanout.members = std::move(members);
+        fanout.total = SeriesStats{};
+        fanout.rounds = 0;
+        return completion;
+    }
+
+    //  :     ,     
+    //   :   ,    -  max_hops
+    static size_t trace_hops(PathTrace& trace) {
+        std::lock_guard<std::mutex> lock(trace.mutex);
+        return trace.destination ? trace.destination : trace.max_hops;
+    }
+
+    void queue_trace_round(const std::shared_ptr<PingTarget>& ping_target, const icmplib::IPAddress& target, std::vector<icmplib::ICMPEngine::Probe>& batch) {
+        size_t hops = trace_hops(*ping_target->trace);
+        auto round = std::make_shared<TraceRound>(hops);
+        for (size_t i = 0; i < hops; ++i) {
+            in_flight++;
+            batch.push_back({ target, [this, ping_target, round, i](const icmplib::PingResult& result) {
+                on_trace_result(ping_target, *round, i, result);
+                governor.release(ProbeProtocol::Icmp);
+                in_flight--;
+            }, ICMPLIB_TIMEOUT_1S, static_cast<uint8_t>(i + 1) });
+        }
+    }
+
+    //    :       ,     
+    //        trace_callback
+    void fail_trace_round(const std::shared_ptr<PingTarget>& ping_target) {
+        TraceRound round(trace_hops(*ping_target->trace));
+        icmplib::PingResult failure{ icmplib::PingResponseType::Failure, 0, icmplib::IPAddress(), 0, 0 };
+        std::fill(round.results.begin(), round.results.end(), failure);
+        round.remaining = 1;
+        on_trace_result(ping_target, round, 0, failure);
+    }
+
+    void on_trace_result(const std::shared_ptr<PingTarget>& target, TraceRound& round, size_t index, const icmplib::PingResult& result) {
+        round.results[index] = result;
+        if (--round.remaining > 0 || !target->active) {
+            return;
+        }
+
+        Completion completion;
+        completion.address = target->address;
+        completion.hops = apply_trace_round(*target->trace, round);
+        completion.trace = true;
+        push_completion(std::move(completion));
+    }
+
+    //         .    
+    //   -  DESTINATION_UNREACHABLE;    ,  
+    //       - ,   
+    std::vector<HopSummary> apply_trace_round(PathTrace& trace, const TraceRound& round) {
+        std::lock_guard<std::mutex> lock(trace.mutex);
+        size_t count = round.results.size();
+        uint8_t destination = 0;
+        for (size_t i = 0; i < count; ++i) {
+            auto response = round.results[i].response;
+            if (response == icmplib::PingResponseType::Success || response == icmplib::PingResponseType::Unreachable) {
+                destination = static_cast<uint8_t>(i + 1);
+                break;
+            }
+        }
+        trace.destination = destination;
+
+        if (trace.hops[0].stats.sent >= trace_window) {
+            for (auto& hop : trace.hops) {
+                hop = PathTrace::Hop{};
+            }
+        }
+
+        size_t end = destination ? destination : count;
+        for (size_t i = 0; i < end; ++i) {
+            icmplib::PingResult result = round.results[i];
+            PathTrace::Hop& hop = trace.hops[i];
+            if (result.response == icmplib::PingResponseType::TimeExceeded || result.response == icmplib::PingResponseType::Unreachable) {
+                result.response = icmplib::PingResponseType::Success;
+            }
+            if (result.response == icmplib::PingResponseType::Success) {
+                hop.address = result.address;
+                hop.last_ms = result.delay;
+            }
+            hop.stats.add(result.response, result.delay, result.ttl);
+        }
+
+        size_t rows = destination;
+        if (rows == 0) {
+            for (size_t i = 0; i < end; ++i) {
+                if (trace.hops[i].stats.received > 0) {
+                    rows = i + 1;
+                }
+            }
+            rows = std::min(rows + 1, end);
+        }
+
+        std::vector<HopSummary> table(rows);
+        for (size_t i = 0; i < rows; ++i) {
+            table[i].hop = static_cast<uint8_t>(i + 1);
+            table[i].address = trace.hops[i].address;
+            table[i].last_ms = trace.hops[i].last_ms;
+            table[i].stats = trace.hops[i].stats.summary();
+        }
+        return table;
+    }
+
+    void call_trace_callback_safe(const std::string& host, const std::vector<HopSummary>& hops) {
+        std::lock_guard<std::mutex> lock(callback_mutex);
+        if (trace_callback) {
+            try {
+                trace_callback(host, hops);
+            }
+            catch (const std::exception& e) {
+                std::cerr << "Trace callback error for host " << host << ": " << e.what() << std::endl;
+            }
+            catch (...) {
+                std::cerr << "Unknown trace callback error for host " << host << std::endl;
             }
         }
+    }
+
+    void on_ping_result(const std::shared_ptr<PingTarget>& target, const icmplib::PingResult& result, uint32_t timeout_ms) {
+        if (!target->active) {
+            return;
+        }
+
+        if (result.response == icmplib::PingResponseType::Success) {
+            target->rto.sample(result.delay);
+        }
+        else if (result.response == icmplib::PingResponseType::Timeout) {
+            target->rto.timeout();
+        }
+
+        //  ,       
+        Completion completion;
+        if (add_result_to_series(*target, result, timeout_ms, completion.summary)) {
+            completion.address = target->address;
+            push_completion(std::move(completion));
+        }
+    }
+
+    //      ;     ,
+    //     true   
+    bool add_result_to_series(PingTarget& target, const icmplib::PingResult& result, uint32_t timeout_ms, SeriesSummary& summary) {
+        SeriesBuffer& buffer = target.series;
+        //          :  
+        //    ,        late
+        uint32_t index = buffer.claimed.fetch_add(1, std::memory_order_acq_rel);
+        if (index & SeriesBuffer::closed_flag) {
+            buffer.late.fetch_add(1, std::memory_order_release);
+            return false;
+        }
+        if (index < max_series_count) {
+            buffer.samples[index] = { result.delay, result.response, result.ttl, timeout_ms };
+        }
+        if (result.response == icmplib::PingResponseType::Success) {
+            buffer.succeeded.fetch_add(1, std::memory_order_relaxed);
+        }
+        // acq_rel:     ,    
+        uint32_t count = buffer.finished.fetch_add(1, std::memory_order_acq_rel) + 1;
+        if (!target.policy.satisfied(count, buffer.succeeded.load(std::memory_order_relaxed))) {
+            return false;
+        }
+        uint32_t total;
+        if (!buffer.close(total)) {
+            return false;
+        }
+
+        // ,   ,    -  ,   
+        while (buffer.finished.load(std::memory_order_acquire) != total) {
+            std::this_thread::yield();
+        }
+        summary = summarize(buffer, total);
+        return true;
+    }
 
-        if (!results.empty()) {
-            call_callback_safe(address, results);
+    static SeriesSummary summarize(const SeriesBuffer& buffer, uint32_t count) {
+        SeriesStats stats;
+        uint32_t timeout_ms = 0;
+        for (uint32_t i = 0; i < std::min<uint32_t>(count, max_series_count); ++i) {
+            const auto& sample = buffer.samples[i];
+            // ,      Delay,   
+            double delay = sample.response == icmplib::PingResponseType::Timeout ? sample.timeout_ms : sample.delay;
+            stats.add(sample.response, delay, sample.ttl);
+            timeout_ms = sample.timeout_ms;
         }
+        SeriesSummary summary = stats.summary();
+        summary.timeout_ms = timeout_ms;
+        return summary;
     }
 
+    //    ;       
     void flush_all_results() {
-        std::lock_guard<std::mutex> lock(results_mutex);
-        for (auto& [address, results] : series_results) {
-            if (!results.empty()) {
-                call_callback_safe(address, results);
+        std::lock_guard<std::mutex> lock(address_map_mutex);
+        for (auto& [address, location] : address_to_thread) {
+            if (location.target->fanout) {
+                FanOut& fanout = *location.target->fanout;
+                std::lock_guard<std::mutex> fanout_lock(fanout.mutex);
+                if (fanout.rounds > 0) {
+                    Completion completion = take_fanout_series(fanout);
+                    completion.address = address;
+                    push_completion(std::move(completion));
+                }
+                continue;
+            }
+            SeriesBuffer& buffer = location.target->series;
+            uint32_t count;
+            if (buffer.finished.load(std::memory_order_acquire) > 0 && buffer.close(count)) {
+                Completion completion;
+                completion.address = address;
+                completion.summary = summarize(buffer, count);
+                push_completion(std::move(completion));
+            }
+        }
+    }
+
+    void push_completion(Completion&& completion) {
+        if (!completions.try_push(std::move(completion))) {
+            //       -  ,    
+            uint64_t dropped = completions_dropped.fetch_add(1, std::memory_order_relaxed);
+            if (dropped % 1000 == 0) {
+                std::cerr << "Ping results dropped, delivery queue full: " << dropped + 1 << " total" << std::endl;
+            }
+            return;
+        }
+        completions_pushed.fetch_add(1, std::memory_order_release);
+        completions_pushed.notify_one();
+    }
+
+    void delivery_thread() {
+        Completion completion;
+        while (true) {
+            uint32_t seen = completions_pushed.load(std::memory_order_acquire);
+            bool stopping = !delivering;
+            while (completions.try_pop(completion)) {
+                if (completion.trace) {
+                    call_trace_callback_safe(completion.address, completion.hops);
+                }
+                else {
+                    if (!completion.addresses.empty()) {
+                        call_address_callback_safe(completion.address, completion.addresses);
+                    }
+                    call_callback_safe(completion.address, completion.summary);
+                }
+            }
+            if (stopping) {
+                break;
+            }
+            // ,     -   
+            completions_pushed.wait(seen, std::memory_order_acquire);
+        }
+    }
+
+    void call_address_callback_safe(const std::string& host, const std::vector<AddressSummary>& addresses) {
+        std::lock_guard<std::mutex> lock(callback_mutex);
+        if (address_callback) {
+            try {
+                address_callback(host, addresses);
+            }
+            catch (const std::exception& e) {
+                std::cerr << "Address callback error for host " << host << ": " << e.what() << std::endl;
+            }
+            catch (...) {
+                std::cerr << "Unknown address callback error for host " << host << std::endl;
             }
         }
-        series_results.clear();
     }
 
     //   
-    void call_callback_safe(const std::string& host, const std::vector<icmplib::PingResult>& responses) {
+    void call_callback_safe(const std::string& host, const SeriesSummary& summary) {
         std::lock_guard<std::mutex> lock(callback_mutex);
         if (callback) {
             try {
-                callback(host, responses);
+                callback(host, summary);
             }
             catch (const std::exception& e) {
                 std::cerr << "Callback error for host " << host << ": " << e.what() << std::endl;
@@ -250,69 +1237,192 @@ private:
         }
     }
 
+    //  ; ,        
+    std::chrono::microseconds pacing_lead() {
+        long long lead = pacing_lead_us.load();
+        if (lead == 0 || !engine.IsTxTimeActive()) {
+            return std::chrono::microseconds(0);
+        }
+        return std::chrono::microseconds(lead);
+    }
+
+    //       when;        lead
+    void schedule_task(size_t thread_index, uint32_t slot, PingTask& task, std::chrono::steady_clock::time_point when, std::chrono::microseconds lead) {
+        task.due = when;
+        task.timer = wheels[thread_index].schedule(when - lead, slot);
+    }
+
+    //    ; new -    
+    ProbeJob* make_job(size_t thread_index, const std::shared_ptr<PingTarget>& target, std::chrono::steady_clock::time_point send_at) {
+        auto& spare = spare_jobs[thread_index];
+        if (spare.empty()) {
+            return new ProbeJob{ target, send_at };
+        }
+        ProbeJob* job = spare.back();
+        spare.pop_back();
+        job->target = target;
+        job->send_at = send_at;
+        return job;
+    }
+
+    //      ,   .   ,
+    //      ;     -  ,
+    //   ,      
+    void recycle_job(size_t thread_index, ProbeJob* job) {
+        job->target.reset();
+        auto& spare = spare_jobs[thread_index];
+        if (spare.size() < max_spare_jobs) {
+            spare.push_back(job);
+        }
+        else {
+            delete job;
+        }
+    }
+
+    bool has_jobs() const {
+        for (const auto& deque : deques) {
+            if (!deque->empty()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    //     ,     -    
+    bool take_job(size_t thread_index, ProbeJob*& job) {
+        if (deques[thread_index]->pop(job)) {
+            return true;
+        }
+        for (size_t i = 1; i < deques.size(); ++i) {
+            if (deques[(thread_index + i) % deques.size()]->steal(job)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
     void worker_thread(size_t thread_index) {
-        while (running) {
-            PingTask task;
-            bool has_task = false;
+        std::vector<uint32_t> due;
+        std::vector<icmplib::ICMPEngine::Probe> batch;
+        std::vector<ResolvedJob> resolved_jobs;
 
+        while (running) {
+            size_t scheduled = 0;
+            auto lead = pacing_lead();
             {
                 std::unique_lock<std::mutex> lock(*mutexes[thread_index]);
+                auto now = std::chrono::steady_clock::now();
 
-                if (!task_queues[thread_index].empty()) {
-                    auto now = std::chrono::steady_clock::now();
-                    auto next_task = task_queues[thread_index].top();
-
-                    if (next_task.next_ping_time <= now) {
-                        task = next_task;
-                        task_queues[thread_index].pop();
-                        has_task = true;
-
-                        if (task.is_in_series) {
-                            //    
-                            task.pings_remaining--;
-
-                            if (task.pings_remaining > 0) {
-                                //    
-                                task.next_ping_time = now;
-                            }
-                            else {
-                                //   -     
-                                task.is_in_series = false;
-                                task.next_ping_time = now + task.interval;
-                                task.pings_remaining = ping_series_count;
-
-                                //   
-                                std::thread([this, address = task.address]() {
-                                    send_series_results(address);
-                                    }).detach();
-                            }
+                //     ,   
+                due.clear();
+                wheels[thread_index].advance(now, due);
+
+                for (uint32_t slot : due) {
+                    PingTask& task = tasks[thread_index][slot];
+                    PingTarget& target = *task.target;
+                    bool buffered = !target.trace && !target.fanout; //    SeriesBuffer
+                    auto spacing = std::chrono::milliseconds(series_spacing_ms.load());
+                    //        ,    ,
+                    //    ( , )    
+                    //  ;     ,      
+                    auto planned = now - task.due < spacing ? task.due : now;
+                    std::chrono::steady_clock::time_point next_ping_time;
+
+                    if (!task.is_in_series) {
+                        if (buffered && !target.series.drained(task.pings_sent)) {
+                            //      (  )
+                            schedule_task(thread_index, slot, task, planned + spacing, lead);
+                            continue;
                         }
-                        else {
-                            //    
-                            task.is_in_series = true;
-                            task.next_ping_time = now;
+                        //    
+                        task.is_in_series = true;
+                        task.pings_sent = 0;
+                        task.series_start = planned;
+                        if (buffered) {
+                            target.series.reset();
                         }
+                    }
+                    else if (buffered && target.series.closed()) {
+                        //    ,    
+                        task.is_in_series = false;
+                        schedule_task(thread_index, slot, task, phases.next_run(task.phase, task.interval, task.series_start), lead);
+                        continue;
+                    }
 
-                        task_queues[thread_index].push(task);
+                    task.pings_sent++;
+                    if (task.pings_sent < target.policy.max_count) {
+                        //    -   ,   
+                        next_ping_time = planned + spacing;
+                    }
+                    else {
+                        //     -       
+                        task.is_in_series = false;
+                        next_ping_time = phases.next_run(task.phase, task.interval, task.series_start);
                     }
+
+                    schedule_task(thread_index, slot, task, next_ping_time, lead);
+                    deques[thread_index]->push(make_job(thread_index, task.target, lead.count() > 0 ? planned : std::chrono::steady_clock::time_point{}));
+                    scheduled++;
                 }
+            }
 
-                if (!has_task) {
-                    if (task_queues[thread_index].empty()) {
-                        cvs[thread_index]->wait_for(lock, std::chrono::seconds(1));
+            //   ,     
+            if (scheduled > 1) {
+                for (size_t i = 0; i < cvs.size(); ++i) {
+                    if (i != thread_index) {
+                        cvs[i]->notify_one();
                     }
-                    else {
-                        auto next_time = task_queues[thread_index].top().next_ping_time;
-                        cvs[thread_index]->wait_until(lock, next_time);
+                }
+            }
+
+            //      ,   ;  , 
+            //    sendmmsg  .     , 
+            //    :    ,    
+            //        .   
+            ProbeJob* job;
+            bool worked = false;
+            size_t credit = 0;
+            while (running) {
+                if (credit == 0) {
+                    if (!has_jobs()) {
+                        break;
                     }
+                    size_t wanted = std::clamp<size_t>(deques[thread_index]->size(), 1, ICMPLIB_ENGINE_BATCH);
+                    credit = governor.acquire(ProbeProtocol::Icmp, wanted, &running);
+                }
+                if (!take_job(thread_index, job)) {
+                    break;
+                }
+                size_t first = batch.size();
+                ping_host(thread_index, job->target, batch);
+                for (size_t i = first; i < batch.size(); ++i) {
+                    batch[i].sendAt = job->send_at;
+                }
+                recycle_job(thread_index, job);
+                worked = true;
+                if (batch.size() >= credit || batch.size() >= ICMPLIB_ENGINE_BATCH) {
+                    submit(batch, credit);
                 }
             }
+            if (!batch.empty()) {
+                submit(batch, credit);
+            }
+            if (credit > 0) {
+                governor.refund(ProbeProtocol::Icmp, credit);
+            }
+            submit_resolved(thread_index, resolved_jobs, batch);
 
-            if (has_task) {
-                ping_host(task.address);
-                //      
-                if (task.is_in_series && task.pings_remaining > 0) {
-                    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            if (!worked && running) {
+                std::unique_lock<std::mutex> lock(*mutexes[thread_index]);
+                if (!resolved[thread_index].empty()) {
+                    continue;
+                }
+                auto next_time = wheels[thread_index].next_expiry();
+                if (!next_time) {
+                    cvs[thread_index]->wait_for(lock, std::chrono::seconds(1));
+                }
+                else {
+                    cvs[thread_index]->wait_until(lock, *next_time);
                 }
             }
         }
@@ -41,12 +41,24 @@
 #define ICMPLIB_RECV_BUFFER_SIZE 1024
 #endif
 
+// Room for the TTL / hop limit and the kernel timestamp of a received message
+#define ICMPLIB_CONTROL_SIZE 128
+
 #define _WINSOCK_DEPRECATED_NO_WARNINGS
 
 #include <chrono>
 #include <string>
 #include <thread>
-#include <regex>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <queue>
+#include <future>
+#include <random>
+#include <functional>
+#include <type_traits>
+#include <algorithm>
+#include <unordered_map>
 #ifdef _WIN32
 #define _WIN32_WINNT 0x0601
 #include <ws2tcpip.h>
@@ -57,8 +69,19 @@
 #include <fcntl.h>
 #include <netdb.h>
 #include <cstring>
+#include <cerrno>
 #include <climits>
 #endif
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include <linux/errqueue.h>
+#include <linux/filter.h>
+#include <linux/net_tstamp.h>
+#include <time.h>
+#endif
 
 #define ICMPLIB_ICMP_ECHO_RESPONSE 0
 #define ICMPLIB_ICMP_DESTINATION_UNREACHABLE 3
@@ -76,6 +99,29 @@
 
 #define ICMPLIB_TIMEOUT_1S 1000
 
+#ifndef ICMPLIB_ENGINE_ID_SPAN
+#define ICMPLIB_ENGINE_ID_SPAN 16
+#endif
+
+#ifndef ICMPLIB_ENGINE_BATCH
+#define ICMPLIB_ENGINE_BATCH 64
+#endif
+
+#ifndef ICMPLIB_ENGINE_RCVBUF
+#define ICMPLIB_ENGINE_RCVBUF (4 * 1024 * 1024)
+#endif
+
+// Waits of up to 10 ms for a full send buffer to drain before a request is reported as failed
+#ifndef ICMPLIB_ENGINE_SEND_WAITS
+#define ICMPLIB_ENGINE_SEND_WAITS 100
+#endif
+
+// A paced request whose transmit timestamp is earlier than planned by more than this is counted
+// as sent early, i.e. the qdisc ignores SO_TXTIME
+#ifndef ICMPLIB_ENGINE_TXTIME_SLACK_NS
+#define ICMPLIB_ENGINE_TXTIME_SLACK_NS 200000
+#endif
+
 #ifdef _WIN32
 #define ICMPLIB_SOCKET SOCKET
 #define ICMPLIB_SOCKLEN int
@@ -121,6 +167,7 @@ namespace icmplib {
     };
 
 #endif
+    // Address value stored inline in sockaddr_storage: copies are plain memcpy and never allocate
     class IPAddress {
     public:
         enum class Type {
@@ -129,40 +176,17 @@ namespace icmplib {
             Unknown
         };
         IPAddress() {
-            address = reinterpret_cast<sockaddr *>(new sockaddr_in);
-            std::memset(address, 0, sizeof(sockaddr_in));
-            reinterpret_cast<sockaddr_in *>(address)->sin_family = AF_INET;
+            std::memset(&address, 0, sizeof(address));
+            address.ss_family = AF_INET;
         }
         IPAddress(const std::string &address, Type type = Type::Unknown) : IPAddress() {
-            auto init = [&](Type type) {
-                switch (type) {
-                case Type::IPv6:
-                    delete this->address;
-                    this->address = reinterpret_cast<sockaddr *>(new sockaddr_in6);
-                    std::memset(this->address, 0, sizeof(sockaddr_in6));
-                    reinterpret_cast<sockaddr_in6 *>(this->address)->sin6_family = AF_INET6;
-                    if (inet_pton(AF_INET6, address.c_str(), &reinterpret_cast<sockaddr_in6 *>(this->address)->sin6_addr) <= 0) {
-                        throw std::runtime_error("Incorrect IPv6 address provided");
-                    }
-                    break;
-                case Type::IPv4:
-                default:
-                    if (inet_pton(AF_INET, address.c_str(), &reinterpret_cast<sockaddr_in *>(this->address)->sin_addr) <= 0) {
-                        throw std::runtime_error("Incorrect IPv4 address provided");
-                    }
-                }
-            };
-            if ((type != Type::Unknown) && IsCorrect(address, type)) {
-                init(type);
+            // Literals are parsed in place, anything else is treated as a host name
+            if ((type != Type::IPv6) && (inet_pton(AF_INET, address.c_str(), &reinterpret_cast<sockaddr_in *>(&this->address)->sin_addr) == 1)) {
+                return;
+            }
+            if ((type != Type::IPv4) && (inet_pton(AF_INET6, address.c_str(), &reinterpret_cast<sockaddr_in6 *>(&this->address)->sin6_addr) == 1)) {
+                this->address.ss_family = AF_INET6;
                 return;
-            } else if (type == Type::Unknown) {
-                if (IsCorrect(address, Type::IPv4)) {
-                    init(Type::IPv4);
-                    return;
-                } else if (IsCorrect(address, Type::IPv6)) {
-                    init(Type::IPv6);
-                    return;
-                }
             }
             Resolve(address, type);
         }
@@ -170,53 +194,13 @@ namespace icmplib {
             SetPort(port);
         }
         IPAddress(uint32_t address) : IPAddress() {
-            reinterpret_cast<sockaddr_in *>(this->address)->sin_addr.s_addr = htonl(address);
+            reinterpret_cast<sockaddr_in *>(&this->address)->sin_addr.s_addr = htonl(address);
         }
         IPAddress(uint32_t address, uint16_t port) : IPAddress(address) {
             SetPort(port);
         }
-        IPAddress(const IPAddress &source) {
-            switch (source.GetType()) {
-            case Type::IPv6:
-                address = reinterpret_cast<sockaddr *>(new sockaddr_in6);
-                std::memcpy(address, source.address, sizeof(sockaddr_in6));
-                break;
-            case Type::IPv4:
-            default:
-                address = reinterpret_cast<sockaddr *>(new sockaddr_in);
-                std::memcpy(address, source.address, sizeof(sockaddr_in));
-            }
-        }
-        IPAddress(IPAddress &&source) {
-            address = source.address;
-            source.address = reinterpret_cast<sockaddr *>(new sockaddr_in);
-            std::memset(source.address, 0, sizeof(sockaddr_in));
-            reinterpret_cast<sockaddr_in *>(source.address)->sin_family = AF_INET;
-        }
-        virtual ~IPAddress() {
-            delete address;
-        }
-        IPAddress &operator=(const IPAddress &source) {
-            delete address;
-            switch (source.GetType()) {
-            case Type::IPv6:
-                address = reinterpret_cast<sockaddr *>(new sockaddr_in6);
-                std::memcpy(address, source.address, sizeof(sockaddr_in6));
-                break;
-            case Type::IPv4:
-            default:
-                address = reinterpret_cast<sockaddr *>(new sockaddr_in);
-                std::memcpy(address, source.address, sizeof(sockaddr_in));
-            }
-            return *this;
-        }
-        IPAddress &operator=(IPAddress &&source) {
-            delete address;
-            address = source.address;
-            source.address = reinterpret_cast<sockaddr *>(new sockaddr_in);
-            std::memset(source.address, 0, sizeof(sockaddr_in));
-            reinterpret_cast<sockaddr_in *>(source.address)->sin_family = AF_INET;
-            return *this;
+        IPAddress(const sockaddr *address, size_t length) : IPAddress() {
+            std::memcpy(&this->address, address, std::min(length, sizeof(this->address)));
         }
         IPAddress &Resolve(const std::string &address, Type type = Type::IPv4) {
 #ifdef _WIN32
@@ -236,21 +220,17 @@ namespace icmplib {
                         if ((type != Type::IPv4) && (type != Type::Unknown)) {
                             break;
                         }
-                        delete this->address;
-                        this->address = reinterpret_cast<sockaddr *>(new sockaddr_in);
-                        std::memcpy(this->address, ptr->ai_addr, sizeof(sockaddr_in));
+                        std::memset(&this->address, 0, sizeof(this->address));
+                        std::memcpy(&this->address, ptr->ai_addr, sizeof(sockaddr_in));
                         freeaddrinfo(result);
-                        type = Type::IPv4;
                         return *this;
                     case AF_INET6:
                         if ((type != Type::IPv6) && (type != Type::Unknown)) {
                             break;
                         }
-                        delete this->address;
-                        this->address = reinterpret_cast<sockaddr *>(new sockaddr_in6);
-                        std::memcpy(this->address, ptr->ai_addr, sizeof(sockaddr_in6));
+                        std::memset(&this->address, 0, sizeof(this->address));
+                        std::memcpy(&this->address, ptr->ai_addr, sizeof(sockaddr_in6));
                         freeaddrinfo(result);
-                        type = Type::IPv6;
                         return *this;
                     default:
                         break;
@@ -264,13 +244,13 @@ namespace icmplib {
             char buffer[INET6_ADDRSTRLEN];
             switch (GetType()) {
             case Type::IPv6:
-                if (inet_ntop(AF_INET6, &reinterpret_cast<sockaddr_in6 *>(address)->sin6_addr, buffer, INET6_ADDRSTRLEN) != NULL) {
+                if (inet_ntop(AF_INET6, &reinterpret_cast<const sockaddr_in6 *>(&address)->sin6_addr, buffer, INET6_ADDRSTRLEN) != NULL) {
                     return std::string(buffer);
                 }
                 throw std::runtime_error("Cannot convert IPv6 address structure");
             case Type::IPv4:
             default:
-                if (inet_ntop(AF_INET, &reinterpret_cast<sockaddr_in *>(address)->sin_addr, buffer, INET6_ADDRSTRLEN) != NULL) {
+                if (inet_ntop(AF_INET, &reinterpret_cast<const sockaddr_in *>(&address)->sin_addr, buffer, INET6_ADDRSTRLEN) != NULL) {
                     return std::string(buffer);
                 }
                 throw std::runtime_error("Cannot convert IPv4 address structure");
@@ -279,25 +259,24 @@ namespace icmplib {
         void SetPort(uint16_t port) {
             switch (GetType()) {
             case Type::IPv6:
-                reinterpret_cast<sockaddr_in6 *>(address)->sin6_port = htons(port);
+                reinterpret_cast<sockaddr_in6 *>(&address)->sin6_port = htons(port);
                 break;
             case Type::IPv4:
             default:
-                reinterpret_cast<sockaddr_in *>(address)->sin_port = htons(port);
+                reinterpret_cast<sockaddr_in *>(&address)->sin_port = htons(port);
             }
         }
         uint16_t GetPort() const {
             switch (GetType()) {
             case Type::IPv6:
-                return ntohs(reinterpret_cast<sockaddr_in6 *>(address)->sin6_port);
-                break;
+                return ntohs(reinterpret_cast<const sockaddr_in6 *>(&address)->sin6_port);
             case Type::IPv4:
             default:
-                return ntohs(reinterpret_cast<sockaddr_in *>(address)->sin_port);
+                return ntohs(reinterpret_cast<const sockaddr_in *>(&address)->sin_port);
             }
         }
         Type GetType() const {
-            switch (address->sa_family) {
+            switch (address.ss_family) {
             case AF_INET6:
                 return Type::IPv6;
             case AF_INET:
@@ -305,8 +284,11 @@ namespace icmplib {
                 return Type::IPv4;
             }
         }
-        sockaddr *GetSockAddr() const {
-            return address;
+        sockaddr *GetSockAddr() {
+            return reinterpret_cast<sockaddr *>(&address);
+        }
+        const sockaddr *GetSockAddr() const {
+            return reinterpret_cast<const sockaddr *>(&address);
         }
         ICMPLIB_SOCKLEN GetSockAddrLength() const {
             switch (GetType()) {
@@ -317,12 +299,23 @@ namespace icmplib {
                 return sizeof(sockaddr_in);
             }
         }
+        // Same family and address as the given socket address; the port is ignored
+        bool IsSameHost(const sockaddr *other) const {
+            if (other->sa_family != address.ss_family) {
+                return false;
+            }
+            if (GetType() == Type::IPv6) {
+                return std::memcmp(&reinterpret_cast<const sockaddr_in6 *>(other)->sin6_addr, &reinterpret_cast<const sockaddr_in6 *>(&address)->sin6_addr, sizeof(in6_addr)) == 0;
+            }
+            return reinterpret_cast<const sockaddr_in *>(other)->sin_addr.s_addr == reinterpret_cast<const sockaddr_in *>(&address)->sin_addr.s_addr;
+        }
         static bool IsCorrect(const std::string &address, Type type = Type::IPv4) {
+            in6_addr buffer;
             switch (type) {
             case Type::IPv4:
-                return std::regex_match(address, std::regex("^(?:(?:25[0-5]|2[0-4][0-9]|[01]?[0-9][0-9]?)\\.){3}(?:25[0-5]|2[0-4][0-9]|[01]?[0-9][0-9]?)$"));
+                return inet_pton(AF_INET, address.c_str(), &buffer) == 1;
             case Type::IPv6:
-                return std::regex_match(address, std::regex("^(([0-9a-fA-F]{1,4}:){7,7}[0-9a-fA-F]{1,4}|([0-9a-fA-F]{1,4}:){1,7}:|([0-9a-fA-F]{1,4}:){1,6}:[0-9a-fA-F]{1,4}|([0-9a-fA-F]{1,4}:){1,5}(:[0-9a-fA-F]{1,4}){1,2}|([0-9a-fA-F]{1,4}:){1,4}(:[0-9a-fA-F]{1,4}){1,3}|([0-9a-fA-F]{1,4}:){1,3}(:[0-9a-fA-F]{1,4}){1,4}|([0-9a-fA-F]{1,4}:){1,2}(:[0-9a-fA-F]{1,4}){1,5}|[0-9a-fA-F]{1,4}:((:[0-9a-fA-F]{1,4}){1,6})|:((:[0-9a-fA-F]{1,4}){1,7}|:)|fe80:(:[0-9a-fA-F]{0,4}){0,4}%[0-9a-zA-Z]{1,}|::(ffff(:0{1,4}){0,1}:){0,1}((25[0-5]|(2[0-4]|1{0,1}[0-9]){0,1}[0-9])\\.){3,3}(25[0-5]|(2[0-4]|1{0,1}[0-9]){0,1}[0-9])|([0-9a-fA-F]{1,4}:){1,4}:((25[0-5]|(2[0-4]|1{0,1}[0-9]){0,1}[0-9])\\.){3,3}(25[0-5]|(2[0-4]|1{0,1}[0-9]){0,1}[0-9]))$"));
+                return inet_pton(AF_INET6, address.c_str(), &buffer) == 1;
             default:
                 return IsCorrect(address, Type::IPv4) || IsCorrect(address, Type::IPv6);
             }
@@ -337,10 +330,19 @@ namespace icmplib {
             }
         }
     private:
-        sockaddr *address;
+        sockaddr_storage address;
     };
 
+    enum class SocketMode {
+        Auto,
+        Datagram,
+        Raw
+    };
+
+    class ICMPEngine;
+
     class ICMPEcho {
+        friend class ICMPEngine;
     public:
         struct Result {
             enum class ResponseType {
@@ -356,6 +358,7 @@ namespace icmplib {
             uint8_t code;
             uint8_t ttl;
         };
+        static_assert(std::is_trivially_copyable<Result>::value, "Result must stay trivially copyable");
         ICMPEcho() = delete;
         ICMPEcho(const ICMPEcho &) = delete;
         ICMPEcho(ICMPEcho &&) = delete;
@@ -368,14 +371,15 @@ namespace icmplib {
 #endif
                 ICMPSocket sock(target.GetType(), ttl);
 
-                ICMPRequest request(target.GetType(), sequence);
+                ICMPRequest request = sock.IsDatagram() ? ICMPRequest(target.GetType(), sock.GetIdentifier(), sequence) : ICMPRequest(target.GetType(), sequence);
+                sock.SetFilter(target.GetType(), request.id, 1);
                 request.Send(sock.GetSocket(), target);
                 auto start = std::chrono::high_resolution_clock::now();
                 IPAddress source(target);
 
                 while (true) {
                     ICMPResponse response;
-                    bool recv = response.Receive(sock.GetSocket(), source, timeout);
+                    bool recv = response.Receive(sock.GetSocket(), source, timeout, sock.IsDatagram());
                     auto end = std::chrono::high_resolution_clock::now();
                     if (!recv) {
                         unsigned delta = static_cast<unsigned>(std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count());
@@ -388,7 +392,13 @@ namespace icmplib {
 
                     result.response = (source.GetType() != IPAddress::Type::IPv6) ? GetResponseType(request, response) : GetResponseTypeV6(request, response);
                     if (result.response != Result::ResponseType::Timeout) {
-                        result.delay = static_cast<double>(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count()) / 1000.0;
+                        // Kernel timestamps exclude the time the reply waited for this thread to run
+                        int64_t sent = sock.ReadSendTime();
+                        if (sent && (response.GetTimestamp() > sent)) {
+                            result.delay = static_cast<double>(response.GetTimestamp() - sent) / 1000000.0;
+                        } else {
+                            result.delay = static_cast<double>(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count()) / 1000.0;
+                        }
                         result.address = source;
                         result.code = response.GetICMPHeader().code;
                         result.ttl = response.GetTTL();
@@ -420,13 +430,33 @@ namespace icmplib {
 
         class ICMPSocket {
         public:
-            ICMPSocket(IPAddress::Type type, uint8_t ttl) {
+            ICMPSocket(IPAddress::Type type, uint8_t ttl, SocketMode mode = SocketMode::Auto) : datagram(false), identifier(0) {
                 int protocol = IPPROTO_ICMP;
                 if (type == IPAddress::Type::IPv6) {
                     protocol = IPPROTO_ICMPV6;
                 }
 
+#ifdef __linux__
+                // Ping sockets (net.ipv4.ping_group_range) need no CAP_NET_RAW and receive only own replies.
+                // In Auto mode any failure to create or set up one falls back to a raw socket
+                sock = ICMPLIB_SOCKET_ERROR;
+                if (mode != SocketMode::Raw) {
+                    sock = socket(IPAddress::GetFamily(type), SOCK_DGRAM, protocol);
+                    datagram = sock > 0;
+                    if (datagram && !SetupDatagram(type)) {
+                        ICMPLIB_CLOSESOCKET(sock);
+                        datagram = false;
+                    }
+                    if (!datagram && (mode == SocketMode::Datagram)) {
+                        throw std::runtime_error("Cannot initialize socket!");
+                    }
+                }
+                if (!datagram) {
+                    sock = socket(IPAddress::GetFamily(type), SOCK_RAW, protocol);
+                }
+#else
                 sock = socket(IPAddress::GetFamily(type), SOCK_RAW, protocol);
+#endif
 #ifdef _WIN32
                 if (sock == INVALID_SOCKET) {
 #else
@@ -435,9 +465,10 @@ namespace icmplib {
                     throw std::runtime_error("Cannot initialize socket!");
                 }
 
+                int hops = ttl;
                 switch (type) {
                 case IPAddress::Type::IPv6:
-                    if (setsockopt(sock, IPPROTO_IPV6, IPV6_UNICAST_HOPS, reinterpret_cast<char *>(&ttl), sizeof(uint8_t)) == ICMPLIB_SOCKET_ERROR) {
+                    if (setsockopt(sock, IPPROTO_IPV6, IPV6_UNICAST_HOPS, reinterpret_cast<char *>(&hops), sizeof(int)) == ICMPLIB_SOCKET_ERROR) {
                         ICMPLIB_CLOSESOCKET(sock);
                         throw std::runtime_error("Cannot set socket options!");
                     }
@@ -450,6 +481,13 @@ namespace icmplib {
                     }
                 }
 
+#ifdef __linux__
+                // Software timestamps taken by the kernel on transmit and receive; optional, without
+                // them the delay is measured in user space
+                int stamping = SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+                setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPING, &stamping, sizeof(int));
+#endif
+
 #ifdef _WIN32
                 unsigned long mode = 1;
                 if (ioctlsocket(sock, FIONBIO, &mode) != NO_ERROR) {
@@ -467,22 +505,175 @@ namespace icmplib {
             const ICMPLIB_SOCKET &GetSocket() {
                 return sock;
             }
+            bool IsDatagram() const {
+                return datagram;
+            }
+            // Echo identifier assigned by the kernel to a ping socket, as it appears in the packet
+            uint16_t GetIdentifier() const {
+                return identifier;
+            }
+            // Kernel transmit time of the last request sent over the socket, 0 if none was queued
+            int64_t ReadSendTime() {
+                int64_t time = 0;
+#ifdef __linux__
+                while (true) {
+                    uint8_t data[ICMPLIB_RECV_BUFFER_SIZE];
+                    alignas(cmsghdr) uint8_t control[ICMPLIB_CONTROL_SIZE];
+                    iovec vector = { data, sizeof(data) };
+                    msghdr message = {};
+                    message.msg_iov = &vector;
+                    message.msg_iovlen = 1;
+                    message.msg_control = control;
+                    message.msg_controllen = sizeof(control);
+                    if (recvmsg(sock, &message, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+                        break;
+                    }
+                    int64_t stamp = ICMPResponse::GetTimestamp(message);
+                    if (stamp) {
+                        time = stamp;
+                    }
+                }
+#endif
+                return time;
+            }
+            // Attaches a socket filter to a raw socket that passes only echo replies and errors quoting
+            // an echo request with an identifier in [first, first + count), so foreign ICMP traffic
+            // is dropped by the kernel instead of waking the reader. Ping sockets are filtered already
+            bool SetFilter(IPAddress::Type type, uint16_t first, uint16_t count) {
+#ifdef __linux__
+                if (datagram) {
+                    return true;
+                }
+                if ((count == 0) || (count > 128)) {
+                    return false;
+                }
+                bool inet6 = type == IPAddress::Type::IPv6;
+                uint32_t reply = inet6 ? ICMPLIB_ICMPV6_ECHO_RESPONSE : ICMPLIB_ICMP_ECHO_RESPONSE;
+                uint32_t unreachable_type = inet6 ? ICMPLIB_ICMPV6_DESTINATION_UNREACHABLE : ICMPLIB_ICMP_DESTINATION_UNREACHABLE;
+                uint32_t exceeded_type = inet6 ? ICMPLIB_ICMPV6_TIME_EXCEEDED : ICMPLIB_ICMP_TIME_EXCEEDED;
+                uint32_t request_type = inet6 ? ICMPLIB_ICMPV6_ECHO_REQUEST : ICMPLIB_ICMP_ECHO_REQUEST;
+                std::vector<sock_filter> code;
+                auto emit = [&code](sock_filter instruction) {
+                    code.push_back(instruction);
+                    return code.size() - 1;
+                };
+                // Jump offset from the instruction at 'from' to the next one to be emitted
+                auto here = [&code](size_t from) {
+                    return static_cast<uint8_t>(code.size() - from - 1);
+                };
+
+                // X = offset of the ICMP header: raw IPv4 sockets deliver the IP header too
+                if (inet6) {
+                    emit(BPF_STMT(BPF_LDX | BPF_IMM, 0));
+                } else {
+                    emit(BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, 0));
+                }
+                emit(BPF_STMT(BPF_LD | BPF_B | BPF_IND, 0));
+                emit(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, reply, 2, 0));
+                size_t unreachable = emit(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, unreachable_type, 0, 0));
+                size_t exceeded = emit(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, exceeded_type, 0, 0));
+
+                // Echo reply: identifier of the reply itself
+                emit(BPF_STMT(BPF_LD | BPF_H | BPF_IND, 4));
+                size_t skip = emit(BPF_STMT(BPF_JMP | BPF_JA, 0));
+
+                // Error: identifier of the quoted echo request after the original IP header
+                code[unreachable].jt = here(unreachable);
+                code[exceeded].jt = here(exceeded);
+                if (inet6) {
+                    emit(BPF_STMT(BPF_LDX | BPF_IMM, 8 + 40));
+                } else {
+                    emit(BPF_STMT(BPF_LD | BPF_B | BPF_IND, 8));
+                    emit(BPF_STMT(BPF_ALU | BPF_AND | BPF_K, 0x0f));
+                    emit(BPF_STMT(BPF_ALU | BPF_LSH | BPF_K, 2));
+                    emit(BPF_STMT(BPF_ALU | BPF_ADD | BPF_X, 0));
+                    emit(BPF_STMT(BPF_ALU | BPF_ADD | BPF_K, 8));
+                    emit(BPF_STMT(BPF_MISC | BPF_TAX, 0));
+                }
+                emit(BPF_STMT(BPF_LD | BPF_B | BPF_IND, 0));
+                size_t request = emit(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, request_type, 0, 0));
+                emit(BPF_STMT(BPF_LD | BPF_H | BPF_IND, 4));
+
+                // The filter loads halfwords in network order, identifiers are written to the packet as is
+                code[skip].k = here(skip);
+                for (uint16_t i = 0; i < count; i++) {
+                    emit(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ntohs(static_cast<uint16_t>(first + i)), static_cast<uint8_t>(count - i), 0));
+                }
+                code[exceeded].jf = here(exceeded);
+                code[request].jf = here(request);
+                emit(BPF_STMT(BPF_RET | BPF_K, 0));
+                emit(BPF_STMT(BPF_RET | BPF_K, 0xffffffff));
+
+                sock_fprog program = { static_cast<unsigned short>(code.size()), code.data() };
+                return setsockopt(sock, SOL_SOCKET, SO_ATTACH_FILTER, &program, sizeof(program)) != ICMPLIB_SOCKET_ERROR;
+#else
+                (void)type;
+                (void)first;
+                (void)count;
+                return false;
+#endif
+            }
         private:
+#ifdef __linux__
+            bool SetupDatagram(IPAddress::Type type) {
+                int enable = 1;
+                sockaddr_storage local;
+                std::memset(&local, 0, sizeof(sockaddr_storage));
+                local.ss_family = static_cast<sa_family_t>(IPAddress::GetFamily(type));
+                socklen_t length = (type == IPAddress::Type::IPv6) ? sizeof(sockaddr_in6) : sizeof(sockaddr_in);
+                if (type == IPAddress::Type::IPv6) {
+                    if ((setsockopt(sock, IPPROTO_IPV6, IPV6_RECVHOPLIMIT, &enable, sizeof(int)) == ICMPLIB_SOCKET_ERROR) ||
+                        (setsockopt(sock, IPPROTO_IPV6, IPV6_RECVERR, &enable, sizeof(int)) == ICMPLIB_SOCKET_ERROR)) {
+                        return false;
+                    }
+                } else {
+                    if ((setsockopt(sock, IPPROTO_IP, IP_RECVTTL, &enable, sizeof(int)) == ICMPLIB_SOCKET_ERROR) ||
+                        (setsockopt(sock, IPPROTO_IP, IP_RECVERR, &enable, sizeof(int)) == ICMPLIB_SOCKET_ERROR)) {
+                        return false;
+                    }
+                }
+                // Binding to port 0 makes the kernel pick the echo identifier up front
+                if ((bind(sock, reinterpret_cast<sockaddr *>(&local), length) == ICMPLIB_SOCKET_ERROR) ||
+                    (getsockname(sock, reinterpret_cast<sockaddr *>(&local), &length) == ICMPLIB_SOCKET_ERROR)) {
+                    return false;
+                }
+                identifier = (type == IPAddress::Type::IPv6) ? reinterpret_cast<sockaddr_in6 *>(&local)->sin6_port : reinterpret_cast<sockaddr_in *>(&local)->sin_port;
+                return true;
+            }
+#endif
             ICMPLIB_SOCKET sock;
+            bool datagram;
+            uint16_t identifier;
         };
 
         class ICMPRequest : public ICMPEchoMessage {
         public:
             ICMPRequest() = delete;
-            ICMPRequest(IPAddress::Type protocol, uint16_t sequence = 1) {
+            ICMPRequest(IPAddress::Type protocol, uint16_t sequence = 1) : ICMPRequest(protocol, rand() % USHRT_MAX, sequence) { }
+            ICMPRequest(IPAddress::Type protocol, uint16_t identifier, uint16_t sequence) {
                 std::memset(this, 0, sizeof(ICMPEchoMessage));
-                id = rand() % USHRT_MAX;
+                id = identifier;
                 type = (protocol != IPAddress::Type::IPv6) ? ICMPLIB_ICMP_ECHO_REQUEST : ICMPLIB_ICMPV6_ECHO_REQUEST;
                 seq = sequence;
                 if (protocol != IPAddress::Type::IPv6) {
                     SetChecksum<ICMPEchoMessage>(*this);
                 }
             }
+            // Sets identifier and sequence of a request copied from a template. The checksum is adjusted
+            // incrementally (RFC 1624, eqn. 3) instead of summing the whole message again; ICMPv6
+            // checksums are filled in by the kernel
+            void Stamp(uint16_t identifier, uint16_t sequence) {
+                if (type == ICMPLIB_ICMP_ECHO_REQUEST) {
+                    uint32_t sum = static_cast<uint16_t>(~checksum);
+                    sum += static_cast<uint16_t>(~id) + static_cast<uint32_t>(identifier);
+                    sum += static_cast<uint16_t>(~seq) + static_cast<uint32_t>(sequence);
+                    sum = (sum >> 16) + (sum & 0xffff);
+                    sum += (sum >> 16);
+                    checksum = static_cast<uint16_t>(~sum);
+                }
+                id = identifier;
+                seq = sequence;
+            }
             void Send(ICMPLIB_SOCKET sock, const IPAddress &address) {
                 int bytes = sendto(sock, reinterpret_cast<char *>(this), sizeof(ICMPEchoMessage), 0, address.GetSockAddr(), address.GetSockAddrLength());
                 if (bytes == ICMPLIB_SOCKET_ERROR) {
@@ -493,15 +684,11 @@ namespace icmplib {
 
         class ICMPResponse {
         public:
-            ICMPResponse() : protocol(IPAddress::Type::IPv4), header(nullptr), length(0) {
+            ICMPResponse() : protocol(IPAddress::Type::IPv4), header(), length(0), offset(0), ttl(0), timestamp(0), verified(-1) {
                 std::memset(&buffer, 0, sizeof(uint8_t) * ICMPLIB_RECV_BUFFER_SIZE);
             }
-            virtual ~ICMPResponse() {
-                if (header) {
-                    delete header;
-                }
-            }
-            bool Receive(ICMPLIB_SOCKET sock, IPAddress &address, unsigned timeout) {
+            virtual ~ICMPResponse() {}
+            bool Receive(ICMPLIB_SOCKET sock, IPAddress &address, unsigned timeout, bool datagram = false) {
                 fd_set sock_set;
                 FD_ZERO(&sock_set);
                 FD_SET(sock, &sock_set);
@@ -514,16 +701,83 @@ namespace icmplib {
                 if ((activity <= 0) | !FD_ISSET(sock, &sock_set)) {
                     return false;
                 }
-
+                return Read(sock, address, datagram);
+            };
+            // Datagram (ping) sockets deliver IPv4 replies without the IP header and report TTL via ancillary data
+            bool Read(ICMPLIB_SOCKET sock, IPAddress &address, bool datagram = false) {
+#ifdef _WIN32
                 ICMPLIB_SOCKLEN length = address.GetSockAddrLength();
                 int bytes = recvfrom(sock, reinterpret_cast<char *>(buffer), ICMPLIB_RECV_BUFFER_SIZE, 0, address.GetSockAddr(), &length);
-                if (bytes <= 0) {
+                ttl = 0;
+                timestamp = 0;
+#else
+                iovec vector = { buffer, ICMPLIB_RECV_BUFFER_SIZE };
+                alignas(cmsghdr) uint8_t control[ICMPLIB_CONTROL_SIZE];
+                msghdr message = {};
+                message.msg_name = address.GetSockAddr();
+                message.msg_namelen = address.GetSockAddrLength();
+                message.msg_iov = &vector;
+                message.msg_iovlen = 1;
+                message.msg_control = control;
+                message.msg_controllen = sizeof(control);
+                int bytes = static_cast<int>(recvmsg(sock, &message, 0));
+                ReadControl(message);
+#endif
+                return Load(bytes, address.GetType(), datagram);
+            }
+#ifndef _WIN32
+            // TTL / hop limit (IP_RECVTTL / IPV6_RECVHOPLIMIT) and kernel receive time from ancillary data
+            void ReadControl(const msghdr &message) {
+                ttl = 0;
+                for (cmsghdr *cmsg = CMSG_FIRSTHDR(&message); cmsg != NULL; cmsg = CMSG_NXTHDR(const_cast<msghdr *>(&message), cmsg)) {
+                    if (((cmsg->cmsg_level == IPPROTO_IP) && (cmsg->cmsg_type == IP_TTL)) ||
+                        ((cmsg->cmsg_level == IPPROTO_IPV6) && (cmsg->cmsg_type == IPV6_HOPLIMIT))) {
+                        int value;
+                        std::memcpy(&value, CMSG_DATA(cmsg), sizeof(int));
+                        ttl = static_cast<uint8_t>(value);
+                    }
+                }
+                timestamp = GetTimestamp(message);
+            }
+            // Software timestamp (SCM_TIMESTAMPING) of a message in nanoseconds of CLOCK_REALTIME, 0 if absent
+            static int64_t GetTimestamp(const msghdr &message) {
+#ifdef __linux__
+                for (cmsghdr *cmsg = CMSG_FIRSTHDR(&message); cmsg != NULL; cmsg = CMSG_NXTHDR(const_cast<msghdr *>(&message), cmsg)) {
+                    if ((cmsg->cmsg_level == SOL_SOCKET) && (cmsg->cmsg_type == SCM_TIMESTAMPING)) {
+                        scm_timestamping stamps;
+                        std::memcpy(&stamps, CMSG_DATA(cmsg), sizeof(scm_timestamping));
+                        return static_cast<int64_t>(stamps.ts[0].tv_sec) * 1000000000 + stamps.ts[0].tv_nsec;
+                    }
+                }
+#else
+                (void)message;
+#endif
+                return 0;
+            }
+#endif
+        private:
+            friend class ICMPEngine;
+
+            // Validates a message already placed in the buffer; ttl holds the ancillary value if any
+            bool Load(int bytes, IPAddress::Type protocol, bool datagram) {
+                this->protocol = protocol;
+                offset = ((protocol != IPAddress::Type::IPv6) && !datagram) ? ICMPLIB_INET4_HEADER_SIZE : 0;
+                if ((bytes <= 0) || (static_cast<unsigned>(bytes) <= offset)) {
                     return false;
                 }
+                if (offset) {
+                    offset = (buffer[0] & 0x0f) * 4;
+                    if ((offset < ICMPLIB_INET4_HEADER_SIZE) || (static_cast<unsigned>(bytes) <= offset)) {
+                        return false;
+                    }
+                    ttl = buffer[ICMPLIB_INET4_TTL_OFFSET];
+                }
                 this->length = static_cast<unsigned>(bytes);
-                protocol = address.GetType();
+                std::memcpy(&header, &buffer[offset], sizeof(ICMPHeader));
+                verified = -1;
                 return true;
-            };
+            }
+        public:
             template <class T>
             const T Generate() const {
                 if (sizeof(T) > length) {
@@ -531,63 +785,60 @@ namespace icmplib {
                 }
                 T packet;
                 std::memset(&packet, 0, sizeof(T));
-                switch (protocol) {
-                case IPAddress::Type::IPv6:
-                    std::memcpy(&packet, buffer, static_cast<long unsigned>(length) > sizeof(T) ? sizeof(T) : static_cast<long unsigned>(length));
-                    break;
-                case IPAddress::Type::IPv4:
-                default:
-                    std::memcpy(&packet, &buffer[ICMPLIB_INET4_HEADER_SIZE], static_cast<long unsigned>(length) - ICMPLIB_INET4_HEADER_SIZE > sizeof(T) ? sizeof(T) : static_cast<long unsigned>(length) - ICMPLIB_INET4_HEADER_SIZE);
-                }
+                std::memcpy(&packet, &buffer[offset], static_cast<long unsigned>(length) - offset > sizeof(T) ? sizeof(T) : static_cast<long unsigned>(length) - offset);
                 return packet;
             }
-            const ICMPHeader &GetICMPHeader() {
-                if (!header) {
-                    header = new ICMPHeader;
-                    *header = Generate<ICMPHeader>();
+            const ICMPHeader &GetICMPHeader() const {
+                return header;
+            }
+            // Whether the ICMP checksum over the whole message holds; computed once per message
+            bool IsChecksumValid() {
+                if (verified < 0) {
+                    verified = (Checksum(GetData(), GetSize()) == 0) ? 1 : 0;
+                }
+                return verified != 0;
+            }
+            // Identifier of an echo message, 0 if the message is too short
+            uint16_t GetEchoIdentifier() const {
+                uint16_t identifier = 0;
+                if (GetSize() >= sizeof(ICMPHeader) + sizeof(uint16_t)) {
+                    std::memcpy(&identifier, GetData() + sizeof(ICMPHeader), sizeof(uint16_t));
                 }
-                return *header;
+                return identifier;
             }
             IPAddress::Type GetProtocol() const {
                 return protocol;
             }
             uint8_t GetTTL() const {
-                switch (protocol) {
-                case IPAddress::Type::IPv6:
-                    return 0;
-                    break;
-                case IPAddress::Type::IPv4:
-                default:
-                    return buffer[ICMPLIB_INET4_TTL_OFFSET];
-                }
+                return ttl;
+            }
+            // Kernel receive time in nanoseconds, 0 when the socket does not provide timestamps
+            int64_t GetTimestamp() const {
+                return timestamp;
             }
             unsigned GetSize() const {
-                switch (protocol) {
-                case IPAddress::Type::IPv6:
-                    return length;
-                    break;
-                case IPAddress::Type::IPv4:
-                default:
-                    return length - ICMPLIB_INET4_HEADER_SIZE;
-                }
+                return length - offset;
+            }
+            const uint8_t *GetData() const {
+                return &buffer[offset];
             }
         private:
             IPAddress::Type protocol;
             uint8_t buffer[ICMPLIB_RECV_BUFFER_SIZE];
-            ICMPHeader *header;
+            ICMPHeader header;
             unsigned length;
+            unsigned offset;
+            uint8_t ttl;
+            int64_t timestamp;
+            int verified;
         };
 
         static Result::ResponseType GetResponseType(const ICMPRequest &request, ICMPResponse &response) {
             Result::ResponseType result = Result::ResponseType::Timeout;
-            ICMPEchoMessage echo;
-            ICMPRevertedMessage reverted;
             switch (response.GetICMPHeader().type) {
             case ICMPLIB_ICMP_ECHO_RESPONSE:
                 result = Result::ResponseType::Success;
-                echo = response.Generate<ICMPEchoMessage>();
-                echo.checksum = 0;
-                if ((response.GetICMPHeader().checksum != SetChecksum<ICMPEchoMessage>(echo)) || (request.id != echo.id)) {
+                if ((response.GetSize() < sizeof(ICMPEchoMessage)) || !response.IsChecksumValid() || (request.id != response.GetEchoIdentifier())) {
                     result = Result::ResponseType::Unsupported;
                 }
                 break;
@@ -597,9 +848,7 @@ namespace icmplib {
                 if (result == Result::ResponseType::Timeout) {
                     result = Result::ResponseType::TimeExceeded;
                 }
-                reverted = response.Generate<ICMPRevertedMessage>();
-                reverted.checksum = 0;
-                if (response.GetICMPHeader().checksum != SetChecksum<ICMPRevertedMessage>(reverted)) {
+                if ((response.GetSize() < sizeof(ICMPRevertedMessage)) || !response.IsChecksumValid()) {
                     result = Result::ResponseType::Unsupported;
                 }
                 break;
@@ -614,12 +863,10 @@ namespace icmplib {
 
         static Result::ResponseType GetResponseTypeV6(const ICMPRequest &request, ICMPResponse &response) {
             Result::ResponseType result = Result::ResponseType::Timeout;
-            ICMPEchoMessage echo;
             switch (response.GetICMPHeader().type) {
             case ICMPLIB_ICMPV6_ECHO_RESPONSE:
                 result = Result::ResponseType::Success;
-                echo = response.Generate<ICMPEchoMessage>();
-                if (request.id != echo.id) {
+                if ((response.GetSize() < sizeof(ICMPEchoMessage)) || (request.id != response.GetEchoIdentifier())) {
                     result = Result::ResponseType::Unsupported;
                 }
                 break;
@@ -641,21 +888,820 @@ namespace icmplib {
 
         template <class T>
         static uint16_t SetChecksum(T &packet) {
-            uint16_t *element = reinterpret_cast<uint16_t *>(&packet);
-            unsigned long size = sizeof(T);
-            uint32_t sum = 0;
-            for (; size > 1; size -= 2) {
-                sum += *element++;
+            packet.checksum = Checksum(&packet, sizeof(T));
+            return packet.checksum;
+        };
+
+        // Internet checksum (RFC 1071) over 32-bit words: they are added into a 64-bit accumulator, which
+        // cannot overflow for any packet size, so the loop has no carry chain and the compiler can
+        // vectorize it; the 16-bit lanes are folded at the end. Byte order is irrelevant as long as the
+        // result is stored the same way. A message that carries a correct checksum sums to 0
+        static uint16_t Checksum(const void *data, size_t size) {
+            const uint8_t *bytes = static_cast<const uint8_t *>(data);
+            uint64_t sum = 0;
+            for (; size >= 4; size -= 4, bytes += 4) {
+                uint32_t word;
+                std::memcpy(&word, bytes, sizeof(word));
+                sum += word;
             }
             if (size > 0) {
-                sum += *reinterpret_cast<uint8_t *>(element);
+                uint32_t word = 0;
+                std::memcpy(&word, bytes, size);
+                sum += word;
             }
+            sum = (sum >> 32) + (sum & 0xffffffff);
+            sum = (sum >> 32) + (sum & 0xffffffff);
             sum = (sum >> 16) + (sum & 0xffff);
-            sum += (sum >> 16);
-            packet.checksum = static_cast<uint16_t>(~sum);
-            return packet.checksum;
+            sum = (sum >> 16) + (sum & 0xffff);
+            return static_cast<uint16_t>(~sum);
+        }
+    };
+
+#ifdef __linux__
+    class ICMPEngine {
+    public:
+        using Result = ICMPEcho::Result;
+        using Callback = std::function<void(const Result &)>;
+
+        // One echo request of a batch, see SubmitBatch
+        struct Probe {
+            IPAddress target;
+            Callback callback;
+            unsigned timeout = ICMPLIB_TIMEOUT_1S;
+            uint8_t ttl = 255;
+            // Planned departure; with SO_TXTIME enabled the kernel holds the packet until then,
+            // otherwise it is sent immediately. The timeout counts from the later of now and this time
+            std::chrono::steady_clock::time_point sendAt{};
         };
+
+        ICMPEngine(const ICMPEngine &) = delete;
+        ICMPEngine(ICMPEngine &&) = delete;
+        ICMPEngine &operator=(const ICMPEngine &) = delete;
+        virtual ~ICMPEngine() {
+            running = false;
+            Wake();
+            if (receiver.joinable()) {
+                receiver.join();
+            }
+            std::vector<Callback> callbacks;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                for (auto &entry : table) {
+                    callbacks.push_back(std::move(entry.second.callback));
+                }
+                table.clear();
+            }
+            for (auto &callback : callbacks) {
+                callback({ Result::ResponseType::Failure, 0, IPAddress(), 0, 0 });
+            }
+            for (auto &family : families) {
+                family.socket.reset();
+            }
+            ICMPLIB_CLOSESOCKET(wakeup);
+            ICMPLIB_CLOSESOCKET(poller);
+        }
+        static ICMPEngine &Instance() {
+            static ICMPEngine instance;
+            return instance;
+        }
+        // Sends an echo request over the shared socket of the target family and returns immediately.
+        // The callback is invoked exactly once: from the receive loop when a matching reply arrives or
+        // the timeout expires, or from the calling thread when the request cannot be sent.
+        void Submit(const IPAddress &target, Callback callback, unsigned timeout = ICMPLIB_TIMEOUT_1S, uint8_t ttl = 255) {
+            IPAddress::Type type = target.GetType();
+            ICMPLIB_SOCKET sock;
+            uint64_t key;
+            ICMPEcho::ICMPRequest request(type, 0, 0);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!Open(type) || !Allocate(type, key)) {
+                    sock = ICMPLIB_SOCKET_ERROR;
+                } else {
+                    sock = families[Index(type)].socket->GetSocket();
+                    bool wake = false;
+                    request = Register(type, target, key, timeout, std::move(callback), wake);
+                    if (wake) {
+                        Wake();
+                    }
+                }
+            }
+            if (sock == ICMPLIB_SOCKET_ERROR) {
+                callback({ Result::ResponseType::Failure, 0, IPAddress(), 0, 0 });
+                return;
+            }
+            if (!Send(sock, request, target, ttl)) {
+                Complete(key, { Result::ResponseType::Failure, 0, IPAddress(), 0, 0 });
+            }
+        }
+        // Same as Submit for every probe, but the requests of each address family leave in as few
+        // sendmmsg calls as possible. Callbacks are moved out of the probes
+        void SubmitBatch(std::vector<Probe> &probes) {
+            std::vector<uint64_t> keys(probes.size());
+            std::vector<ICMPEcho::ICMPRequest> requests;
+            std::vector<size_t> queued[2];
+            std::vector<size_t> failed;
+            std::vector<uint64_t> times(probes.size(), 0);
+            requests.reserve(probes.size());
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                bool wake = false;
+                auto now = std::chrono::steady_clock::now();
+                // Offset between steady_clock and the clock the SO_TXTIME times are given in
+                bool pacing = txtime && txtimeHonored;
+                int64_t offset = pacing ? ClockNanoseconds(txtimeClock) - Nanoseconds(now) : 0;
+                for (size_t i = 0; i < probes.size(); i++) {
+                    IPAddress::Type type = probes[i].target.GetType();
+                    requests.push_back(templates[Index(type)]);
+                    if (!Open(type) || !Allocate(type, keys[i])) {
+                        failed.push_back(i);
+                        continue;
+                    }
+                    bool paced = pacing && (probes[i].sendAt > now);
+                    requests[i] = Register(type, probes[i].target, keys[i], probes[i].timeout, std::move(probes[i].callback), wake, paced ? probes[i].sendAt : now);
+                    if (paced) {
+                        times[i] = static_cast<uint64_t>(Nanoseconds(probes[i].sendAt) + offset);
+                    }
+                    queued[Index(type)].push_back(i);
+                }
+                if (wake) {
+                    Wake();
+                }
+            }
+            for (size_t i : failed) {
+                probes[i].callback({ Result::ResponseType::Failure, 0, IPAddress(), 0, 0 });
+            }
+
+            for (size_t index = 0; index < 2; index++) {
+                size_t count = queued[index].size();
+                if (count == 0) {
+                    continue;
+                }
+                ICMPLIB_SOCKET sock;
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    sock = families[index].socket->GetSocket();
+                }
+                std::vector<mmsghdr> messages(count);
+                std::vector<iovec> vectors(count);
+                std::vector<Control> controls(count);
+                for (size_t i = 0; i < count; i++) {
+                    Probe &probe = probes[queued[index][i]];
+                    Prepare(messages[i].msg_hdr, vectors[i], controls[i], requests[queued[index][i]], probe.target, probe.ttl, times[queued[index][i]]);
+                }
+                // sendmmsg stops at the first message that fails. A full send buffer is waited out;
+                // any other error belongs to that destination, which is reported and skipped
+                size_t sent = 0;
+                unsigned waits = 0;
+                while (sent < count) {
+                    int bytes = sendmmsg(sock, &messages[sent], static_cast<unsigned>(count - sent), 0);
+                    if (bytes > 0) {
+                        sent += static_cast<size_t>(bytes);
+                        waits = 0;
+                    } else if (WaitWritable(sock, waits)) {
+                        continue;
+                    } else {
+                        Complete(keys[queued[index][sent]], { Result::ResponseType::Failure, 0, IPAddress(), 0, 0 });
+                        sent++;
+                        waits = 0;
+                    }
+                }
+            }
+        }
+        // Blocking convenience wrapper with the same semantics as ICMPEcho::Execute
+        Result Execute(const IPAddress &target, unsigned timeout = ICMPLIB_TIMEOUT_1S, uint8_t ttl = 255) {
+            auto promise = std::make_shared<std::promise<Result>>();
+            auto future = promise->get_future();
+            Submit(target, [promise](const Result &result) {
+                promise->set_value(result);
+            }, timeout, ttl);
+            return future.get();
+        }
+        size_t GetPendingCount() {
+            std::lock_guard<std::mutex> lock(mutex);
+            return table.size();
+        }
+        // Applies to sockets opened after the call; Auto prefers ping sockets and falls back to raw
+        void SetSocketMode(SocketMode mode) {
+            std::lock_guard<std::mutex> lock(mutex);
+            this->mode = mode;
+        }
+        // Mode actually in use for the family, Auto until its socket is opened
+        SocketMode GetSocketMode(IPAddress::Type type) {
+            std::lock_guard<std::mutex> lock(mutex);
+            const Family &family = families[Index(type)];
+            if (!family.socket) {
+                return SocketMode::Auto;
+            }
+            return family.socket->IsDatagram() ? SocketMode::Datagram : SocketMode::Raw;
+        }
+        // Precise pacing: requests with a future Probe::sendAt carry SCM_TXTIME and leave at that time
+        // when the egress qdisc honors it (fq with CLOCK_MONOTONIC, etf with the clock it is configured
+        // for). Returns false when the kernel rejects SO_TXTIME. Transmit timestamps of paced requests
+        // are checked against the plan; if most leave early the qdisc ignores the times and pacing is
+        // switched off again, see IsTxTimeActive
+        bool SetTxTime(bool enable, clockid_t clock = CLOCK_MONOTONIC) {
+            std::lock_guard<std::mutex> lock(mutex);
+            txtime = enable;
+            txtimeClock = clock;
+            txtimeHonored = true;
+            txtimePaced = 0;
+            txtimeEarly = 0;
+            for (auto &family : families) {
+                if (family.socket && !ApplyTxTime(family.socket->GetSocket())) {
+                    txtime = false;
+                }
+            }
+            return txtime == enable;
+        }
+        bool IsTxTimeActive() {
+            std::lock_guard<std::mutex> lock(mutex);
+            return txtime && txtimeHonored;
+        }
+    private:
+        struct Pending {
+            ICMPEcho::ICMPRequest request;
+            IPAddress target; // Replies and quoted requests of ICMP errors must match it
+            std::chrono::steady_clock::time_point start;
+            std::chrono::steady_clock::time_point deadline;
+            unsigned timeout;
+            uint64_t serial;
+            Callback callback;
+            int64_t sent = 0; // Kernel transmit timestamp, filled from the error queue
+            int64_t planned = 0; // CLOCK_REALTIME departure of a paced request, compared with sent
+        };
+
+        struct Deadline {
+            std::chrono::steady_clock::time_point time;
+            uint64_t key;
+            uint64_t serial;
+            bool operator<(const Deadline &other) const {
+                return time > other.time;
+            }
+        };
+
+        struct Family {
+            std::unique_ptr<ICMPEcho::ICMPSocket> socket;
+            bool failed = false;
+        };
+
+        struct Control {
+            alignas(cmsghdr) uint8_t data[ICMPLIB_CONTROL_SIZE];
+        };
+
+        // Receive buffers reused by every recvmmsg call of the receive thread
+        struct Inbox {
+            ICMPEcho::ICMPResponse responses[ICMPLIB_ENGINE_BATCH];
+            mmsghdr messages[ICMPLIB_ENGINE_BATCH];
+            iovec vectors[ICMPLIB_ENGINE_BATCH];
+            sockaddr_storage names[ICMPLIB_ENGINE_BATCH];
+            Control controls[ICMPLIB_ENGINE_BATCH];
+            bool loaded[ICMPLIB_ENGINE_BATCH];
+        };
+
+        ICMPEngine() {
+            std::random_device random;
+            base = static_cast<uint16_t>(random()) & ~static_cast<uint16_t>(ICMPLIB_ENGINE_ID_SPAN - 1);
+            poller = epoll_create1(EPOLL_CLOEXEC);
+            wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if ((poller == ICMPLIB_SOCKET_ERROR) || (wakeup == ICMPLIB_SOCKET_ERROR)) {
+                throw std::runtime_error("Cannot initialize ICMP engine!");
+            }
+            epoll_event event = {};
+            event.events = EPOLLIN;
+            event.data.u64 = Token(2, wakeup);
+            epoll_ctl(poller, EPOLL_CTL_ADD, wakeup, &event);
+            running = true;
+            receiver = std::thread(&ICMPEngine::Run, this);
+        }
+
+        static size_t Index(IPAddress::Type type) {
+            return (type == IPAddress::Type::IPv6) ? 1 : 0;
+        }
+
+        static uint64_t Token(size_t index, ICMPLIB_SOCKET sock) {
+            return (static_cast<uint64_t>(index) << 32) | static_cast<uint32_t>(sock);
+        }
+
+        // Called with the table mutex held
+        bool Open(IPAddress::Type type) {
+            Family &family = families[Index(type)];
+            if (family.socket) {
+                return true;
+            }
+            if (family.failed) {
+                return false;
+            }
+            try {
+                family.socket = std::make_unique<ICMPEcho::ICMPSocket>(type, 255, mode);
+                // Best effort: without the filter foreign packets are still rejected by GetKey
+                family.socket->SetFilter(type, base, ICMPLIB_ENGINE_ID_SPAN);
+                // Replies to a whole batch arrive back to back; the default buffer drops them
+                // once submission outpaces the receiver. FORCE needs CAP_NET_ADMIN, otherwise
+                // the request is capped by net.core.rmem_max
+                int size = ICMPLIB_ENGINE_RCVBUF;
+                ICMPLIB_SOCKET sock = family.socket->GetSocket();
+                if (setsockopt(sock, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof(size)) == ICMPLIB_SOCKET_ERROR) {
+                    setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+                }
+                if (txtime && !ApplyTxTime(sock)) {
+                    txtime = false;
+                }
+            } catch (...) {
+                family.failed = true;
+                return false;
+            }
+            epoll_event event = {};
+            event.events = EPOLLIN;
+            event.data.u64 = Token(Index(type), family.socket->GetSocket());
+            if (epoll_ctl(poller, EPOLL_CTL_ADD, family.socket->GetSocket(), &event) == ICMPLIB_SOCKET_ERROR) {
+                family.socket.reset();
+                family.failed = true;
+                return false;
+            }
+            return true;
+        }
+
+        // Key of a pending request: family index, echo id and sequence as they appear in the packet
+        static uint64_t MakeKey(size_t index, uint16_t id, uint16_t seq) {
+            return (static_cast<uint64_t>(index) << 32) | (static_cast<uint64_t>(id) << 16) | seq;
+        }
+
+        // Picks a free (id, seq) pair; raw sockets use the engine id range, ping sockets
+        // are limited to the identifier the kernel assigned. Called with the table mutex held
+        bool Allocate(IPAddress::Type type, uint64_t &key) {
+            const ICMPEcho::ICMPSocket &socket = *families[Index(type)].socket;
+            uint32_t span = socket.IsDatagram() ? 1 : ICMPLIB_ENGINE_ID_SPAN;
+            for (uint32_t attempt = 0; attempt < span * 0x10000; attempt++) {
+                uint32_t value = counter++;
+                uint16_t id = socket.IsDatagram() ? socket.GetIdentifier() : static_cast<uint16_t>(base + ((value >> 16) % span));
+                key = MakeKey(Index(type), id, static_cast<uint16_t>(value & 0xffff));
+                if (table.find(key) == table.end()) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        // Adds a pending request and returns the echo message to send; wake is set when the
+        // new deadline is the earliest one. start is the planned departure, now for unpaced requests.
+        // Called with the table mutex held
+        ICMPEcho::ICMPRequest Register(IPAddress::Type type, const IPAddress &target, uint64_t key, unsigned timeout, Callback callback, bool &wake,
+                                       std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now()) {
+            ICMPEcho::ICMPRequest request = templates[Index(type)];
+            request.Stamp(static_cast<uint16_t>(key >> 16), static_cast<uint16_t>(key & 0xffff));
+            auto now = std::chrono::steady_clock::now();
+            auto deadline = start + std::chrono::milliseconds(timeout);
+            Pending pending{ request, target, start, deadline, timeout, ++serial, std::move(callback) };
+            if (start > now) {
+                pending.planned = ClockNanoseconds(CLOCK_REALTIME) + Nanoseconds(start) - Nanoseconds(now);
+            }
+            table.emplace(key, std::move(pending));
+            deadlines.push({ deadline, key, serial });
+            if (deadlines.top().serial == serial) {
+                wake = true;
+            }
+            return request;
+        }
+
+        static bool Send(ICMPLIB_SOCKET sock, ICMPEcho::ICMPRequest &request, const IPAddress &target, uint8_t ttl) {
+            msghdr message;
+            iovec vector;
+            Control control;
+            Prepare(message, vector, control, request, target, ttl, 0);
+            unsigned waits = 0;
+            while (sendmsg(sock, &message, 0) == ICMPLIB_SOCKET_ERROR) {
+                if (!WaitWritable(sock, waits)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // After a failed send: true when the error is transient (interrupted call, full send buffer
+        // or device queue) and the socket became writable again within the retry budget
+        static bool WaitWritable(ICMPLIB_SOCKET sock, unsigned &waits) {
+            int error = errno;
+            if (error == EINTR) {
+                return true;
+            }
+            if (((error != EAGAIN) && (error != EWOULDBLOCK) && (error != ENOBUFS)) || (waits >= ICMPLIB_ENGINE_SEND_WAITS)) {
+                return false;
+            }
+            waits++;
+            pollfd fd = { sock, POLLOUT, 0 };
+            // ENOBUFS is not reflected in POLLOUT, so a writable socket still gets a short pause
+            if ((poll(&fd, 1, 10) > 0) && (error == ENOBUFS)) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            return true;
+        }
+
+        // Fills a message header for sendmsg/sendmmsg; a TTL other than 255 and a transmit time
+        // (nanoseconds of the SO_TXTIME clock, 0 for none) go as ancillary data
+        static void Prepare(msghdr &message, iovec &vector, Control &control, ICMPEcho::ICMPRequest &request, const IPAddress &target, uint8_t ttl, uint64_t time) {
+            vector = { &request, sizeof(ICMPEcho::ICMPEchoMessage) };
+            message = {};
+            message.msg_name = const_cast<sockaddr *>(target.GetSockAddr());
+            message.msg_namelen = target.GetSockAddrLength();
+            message.msg_iov = &vector;
+            message.msg_iovlen = 1;
+            control = {};
+            if ((ttl == 255) && !time) {
+                return;
+            }
+            message.msg_control = control.data;
+            message.msg_controllen = (ttl != 255 ? CMSG_SPACE(sizeof(int)) : 0) + (time ? CMSG_SPACE(sizeof(uint64_t)) : 0);
+            cmsghdr *header = CMSG_FIRSTHDR(&message);
+            if (time) {
+                header->cmsg_len = CMSG_LEN(sizeof(uint64_t));
+                header->cmsg_level = SOL_SOCKET;
+                header->cmsg_type = SCM_TXTIME;
+                std::memcpy(CMSG_DATA(header), &time, sizeof(uint64_t));
+                header = CMSG_NXTHDR(&message, header);
+            }
+            if (ttl != 255) {
+                header->cmsg_len = CMSG_LEN(sizeof(int));
+                if (target.GetType() == IPAddress::Type::IPv6) {
+                    header->cmsg_level = IPPROTO_IPV6;
+                    header->cmsg_type = IPV6_HOPLIMIT;
+                } else {
+                    header->cmsg_level = IPPROTO_IP;
+                    header->cmsg_type = IP_TTL;
+                }
+                int value = ttl;
+                std::memcpy(CMSG_DATA(header), &value, sizeof(int));
+            }
+        }
+
+        // Extracts the (id, seq) key of the echo request a response refers to
+        static bool GetKey(ICMPEcho::ICMPResponse &response, uint64_t &key) {
+            const uint8_t *data = response.GetData();
+            unsigned size = response.GetSize();
+            if (size < sizeof(ICMPEcho::ICMPHeader)) {
+                return false;
+            }
+            unsigned offset;
+            if (response.GetProtocol() != IPAddress::Type::IPv6) {
+                switch (data[0]) {
+                case ICMPLIB_ICMP_ECHO_RESPONSE:
+                    offset = 4;
+                    break;
+                case ICMPLIB_ICMP_DESTINATION_UNREACHABLE:
+                case ICMPLIB_ICMP_TIME_EXCEEDED:
+                    if (size < 8 + ICMPLIB_INET4_HEADER_SIZE) {
+                        return false;
+                    }
+                    offset = 8 + (data[8] & 0x0f) * 4 + 4;
+                    break;
+                default:
+                    return false;
+                }
+            } else {
+                switch (data[0]) {
+                case ICMPLIB_ICMPV6_ECHO_RESPONSE:
+                    offset = 4;
+                    break;
+                case ICMPLIB_ICMPV6_DESTINATION_UNREACHABLE:
+                case ICMPLIB_ICMPV6_TIME_EXCEEDED:
+                    offset = 8 + 40 + 4;
+                    break;
+                default:
+                    return false;
+                }
+            }
+            if (size < offset + 4) {
+                return false;
+            }
+            uint16_t id, seq;
+            std::memcpy(&id, &data[offset], sizeof(uint16_t));
+            std::memcpy(&seq, &data[offset + 2], sizeof(uint16_t));
+            key = MakeKey(Index(response.GetProtocol()), id, seq);
+            return true;
+        }
+
+        // The (id, seq) key alone is not enough: in datagram mode only seq varies and wraps, so a late
+        // reply could complete a newer request to another host. An echo reply must come from the
+        // target; an ICMP error comes from any hop, so the destination of the quoted request is checked.
+        // Called after GetKey accepted the response
+        static bool IsFromTarget(ICMPEcho::ICMPResponse &response, const sockaddr_storage &source, const IPAddress &target) {
+            const uint8_t *data = response.GetData();
+            sockaddr_storage quoted = {};
+            if (response.GetProtocol() != IPAddress::Type::IPv6) {
+                if (data[0] == ICMPLIB_ICMP_ECHO_RESPONSE) {
+                    return target.IsSameHost(reinterpret_cast<const sockaddr *>(&source));
+                }
+                quoted.ss_family = AF_INET;
+                std::memcpy(&reinterpret_cast<sockaddr_in *>(&quoted)->sin_addr, &data[8 + 16], sizeof(in_addr));
+            } else {
+                if (data[0] == ICMPLIB_ICMPV6_ECHO_RESPONSE) {
+                    return target.IsSameHost(reinterpret_cast<const sockaddr *>(&source));
+                }
+                quoted.ss_family = AF_INET6;
+                std::memcpy(&reinterpret_cast<sockaddr_in6 *>(&quoted)->sin6_addr, &data[8 + 24], sizeof(in6_addr));
+            }
+            return target.IsSameHost(reinterpret_cast<const sockaddr *>(&quoted));
+        }
+
+        void Complete(uint64_t key, const Result &result) {
+            Callback callback;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                auto it = table.find(key);
+                if (it == table.end()) {
+                    return;
+                }
+                callback = std::move(it->second.callback);
+                table.erase(it);
+            }
+            callback(result);
+        }
+
+        void Wake() {
+            uint64_t value = 1;
+            if (write(wakeup, &value, sizeof(value)) < 0) {
+                return;
+            }
+        }
+
+        // Drains the socket with recvmmsg and completes all matched requests of a batch under one lock
+        void Receive(IPAddress::Type type, ICMPLIB_SOCKET sock, bool datagram) {
+            const IPAddress &any = wildcards[Index(type)];
+            Inbox &box = *inbox;
+            while (true) {
+                for (size_t i = 0; i < ICMPLIB_ENGINE_BATCH; i++) {
+                    box.vectors[i] = { box.responses[i].buffer, ICMPLIB_RECV_BUFFER_SIZE };
+                    msghdr &message = box.messages[i].msg_hdr;
+                    message = {};
+                    message.msg_name = &box.names[i];
+                    message.msg_namelen = sizeof(sockaddr_storage);
+                    message.msg_iov = &box.vectors[i];
+                    message.msg_iovlen = 1;
+                    message.msg_control = box.controls[i].data;
+                    message.msg_controllen = sizeof(box.controls[i].data);
+                }
+                int count = recvmmsg(sock, box.messages, ICMPLIB_ENGINE_BATCH, MSG_DONTWAIT, NULL);
+                if (count <= 0) {
+                    break;
+                }
+                auto end = std::chrono::steady_clock::now();
+                // Parsing and checksums of the whole batch happen before the table lock is taken
+                for (int i = 0; i < count; i++) {
+                    ICMPEcho::ICMPResponse &response = box.responses[i];
+                    response.ReadControl(box.messages[i].msg_hdr);
+                    box.loaded[i] = response.Load(static_cast<int>(box.messages[i].msg_len), type, datagram);
+                    if (box.loaded[i] && (type != IPAddress::Type::IPv6)) {
+                        response.IsChecksumValid();
+                    }
+                }
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    for (int i = 0; i < count; i++) {
+                        ICMPEcho::ICMPResponse &response = box.responses[i];
+                        uint64_t key;
+                        if (!box.loaded[i] || !GetKey(response, key)) {
+                            continue;
+                        }
+                        auto it = table.find(key);
+                        if ((it == table.end()) || !IsFromTarget(response, box.names[i], it->second.target)) {
+                            continue;
+                        }
+                        Result result = { Result::ResponseType::Timeout, 0, any, 0, 0 };
+                        try {
+                            result.response = (type != IPAddress::Type::IPv6) ? ICMPEcho::GetResponseType(it->second.request, response) : ICMPEcho::GetResponseTypeV6(it->second.request, response);
+                        } catch (...) {
+                            continue;
+                        }
+                        if (result.response == Result::ResponseType::Timeout) {
+                            continue;
+                        }
+                        result.delay = Elapsed(it->second, response.GetTimestamp(), end);
+                        result.address = IPAddress(reinterpret_cast<const sockaddr *>(&box.names[i]), sizeof(box.names[i]));
+                        result.code = response.GetICMPHeader().code;
+                        result.ttl = response.GetTTL();
+                        completed.emplace_back(std::move(it->second.callback), std::move(result));
+                        table.erase(it);
+                    }
+                }
+                for (auto &completion : completed) {
+                    completion.first(completion.second);
+                }
+                completed.clear();
+                if (count < ICMPLIB_ENGINE_BATCH) {
+                    break;
+                }
+            }
+        }
+
+        static int64_t Nanoseconds(std::chrono::steady_clock::time_point time) {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+        }
+
+        static int64_t ClockNanoseconds(clockid_t clock) {
+            timespec now;
+            clock_gettime(clock, &now);
+            return static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+        }
+
+        // Called with the table mutex held
+        bool ApplyTxTime(ICMPLIB_SOCKET sock) {
+            sock_txtime config = {};
+            config.clockid = txtimeClock;
+            return setsockopt(sock, SOL_SOCKET, SO_TXTIME, &config, sizeof(config)) != ICMPLIB_SOCKET_ERROR;
+        }
+
+        // Compares the transmit timestamp of a paced request with its plan; a qdisc without
+        // SO_TXTIME support sends such requests right away. Called with the table mutex held
+        void CheckTxTime(int64_t planned, int64_t sent) {
+            txtimePaced++;
+            if (sent + ICMPLIB_ENGINE_TXTIME_SLACK_NS < planned) {
+                txtimeEarly++;
+            }
+            if ((txtimePaced >= 16) && (txtimeEarly * 2 > txtimePaced)) {
+                txtimeHonored = false;
+            }
+        }
+
+        // Delay of a completed request: kernel receive minus transmit time when both stamps are known,
+        // user space clocks otherwise
+        static double Elapsed(const Pending &pending, int64_t received, std::chrono::steady_clock::time_point end) {
+            if (pending.sent && (received > pending.sent)) {
+                return static_cast<double>(received - pending.sent) / 1000000.0;
+            }
+            return static_cast<double>(std::chrono::duration_cast<std::chrono::microseconds>(end - pending.start).count()) / 1000.0;
+        }
+
+        // The error queue carries transmit timestamps and, on ping sockets, ICMP errors that bypass the
+        // data path. A timestamp comes with the sent packet, whose tail is our echo message; an ICMP
+        // error comes with the original echo header. Both give the (id, seq) of the request
+        void ReceiveErrors(IPAddress::Type type, ICMPLIB_SOCKET sock) {
+            while (true) {
+                uint8_t data[ICMPLIB_RECV_BUFFER_SIZE];
+                sockaddr_storage name;
+                alignas(cmsghdr) uint8_t control[512];
+                iovec vector = { data, sizeof(data) };
+                msghdr message = {};
+                message.msg_name = &name;
+                message.msg_namelen = sizeof(name);
+                message.msg_iov = &vector;
+                message.msg_iovlen = 1;
+                message.msg_control = control;
+                message.msg_controllen = sizeof(control);
+                ssize_t bytes = recvmsg(sock, &message, MSG_ERRQUEUE | MSG_DONTWAIT);
+                if (bytes < 0) {
+                    break;
+                }
+                auto end = std::chrono::steady_clock::now();
+                if (bytes < static_cast<ssize_t>(sizeof(ICMPEcho::ICMPHeader) + 4)) {
+                    continue;
+                }
+                int64_t stamp = ICMPEcho::ICMPResponse::GetTimestamp(message);
+                for (cmsghdr *cmsg = CMSG_FIRSTHDR(&message); cmsg != NULL; cmsg = CMSG_NXTHDR(&message, cmsg)) {
+                    if (!((cmsg->cmsg_level == IPPROTO_IP) && (cmsg->cmsg_type == IP_RECVERR)) &&
+                        !((cmsg->cmsg_level == IPPROTO_IPV6) && (cmsg->cmsg_type == IPV6_RECVERR))) {
+                        continue;
+                    }
+                    sock_extended_err error;
+                    std::memcpy(&error, CMSG_DATA(cmsg), sizeof(sock_extended_err));
+                    if (error.ee_origin == SO_EE_ORIGIN_TIMESTAMPING) {
+                        if ((bytes >= static_cast<ssize_t>(sizeof(ICMPEcho::ICMPEchoMessage))) && stamp) {
+                            const uint8_t *echo = &data[bytes - sizeof(ICMPEcho::ICMPEchoMessage)];
+                            uint16_t id, seq;
+                            std::memcpy(&id, echo + 4, sizeof(uint16_t));
+                            std::memcpy(&seq, echo + 6, sizeof(uint16_t));
+                            std::lock_guard<std::mutex> lock(mutex);
+                            auto it = table.find(MakeKey(Index(type), id, seq));
+                            if (it != table.end()) {
+                                it->second.sent = stamp;
+                                if (it->second.planned) {
+                                    CheckTxTime(it->second.planned, stamp);
+                                }
+                            }
+                        }
+                        break;
+                    }
+                    Result result = { Result::ResponseType::Unsupported, 0, IPAddress(), error.ee_code, 0 };
+                    if (error.ee_origin == SO_EE_ORIGIN_ICMP) {
+                        if (error.ee_type == ICMPLIB_ICMP_DESTINATION_UNREACHABLE) {
+                            result.response = Result::ResponseType::Unreachable;
+                        } else if (error.ee_type == ICMPLIB_ICMP_TIME_EXCEEDED) {
+                            result.response = Result::ResponseType::TimeExceeded;
+                        }
+                    } else if (error.ee_origin == SO_EE_ORIGIN_ICMP6) {
+                        if (error.ee_type == ICMPLIB_ICMPV6_DESTINATION_UNREACHABLE) {
+                            result.response = Result::ResponseType::Unreachable;
+                        } else if (error.ee_type == ICMPLIB_ICMPV6_TIME_EXCEEDED) {
+                            result.response = Result::ResponseType::TimeExceeded;
+                        }
+                    } else {
+                        continue;
+                    }
+                    const sockaddr *offender = SO_EE_OFFENDER(reinterpret_cast<const sock_extended_err *>(CMSG_DATA(cmsg)));
+                    if (offender->sa_family == AF_INET) {
+                        result.address = IPAddress(offender, sizeof(sockaddr_in));
+                    } else if (offender->sa_family == AF_INET6) {
+                        result.address = IPAddress(offender, sizeof(sockaddr_in6));
+                    }
+
+                    uint16_t id, seq;
+                    std::memcpy(&id, &data[4], sizeof(uint16_t));
+                    std::memcpy(&seq, &data[6], sizeof(uint16_t));
+                    uint64_t key = MakeKey(Index(type), id, seq);
+                    Callback callback;
+                    {
+                        // The kernel puts the destination of the failed request into msg_name
+                        std::lock_guard<std::mutex> lock(mutex);
+                        auto it = table.find(key);
+                        if ((it == table.end()) || (message.msg_namelen == 0) || !it->second.target.IsSameHost(reinterpret_cast<const sockaddr *>(&name))) {
+                            break;
+                        }
+                        result.delay = Elapsed(it->second, stamp, end);
+                        callback = std::move(it->second.callback);
+                        table.erase(it);
+                    }
+                    callback(result);
+                    break;
+                }
+            }
+        }
+
+        // Completes expired requests and returns the epoll timeout until the next deadline
+        int Expire() {
+            std::vector<std::pair<Callback, unsigned>> expired;
+            int wait = -1;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                auto now = std::chrono::steady_clock::now();
+                while (!deadlines.empty()) {
+                    Deadline deadline = deadlines.top();
+                    auto it = table.find(deadline.key);
+                    if ((it == table.end()) || (it->second.serial != deadline.serial)) {
+                        deadlines.pop();
+                        continue;
+                    }
+                    if (deadline.time > now) {
+                        wait = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(deadline.time - now).count()) + 1;
+                        break;
+                    }
+                    deadlines.pop();
+                    expired.emplace_back(std::move(it->second.callback), it->second.timeout);
+                    table.erase(it);
+                }
+            }
+            for (auto &[callback, timeout] : expired) {
+                callback({ Result::ResponseType::Timeout, static_cast<double>(timeout), IPAddress(), 0, 0 });
+            }
+            return wait;
+        }
+
+        void Run() {
+            epoll_event events[8];
+            int wait = -1;
+            while (running) {
+                int count = epoll_wait(poller, events, 8, wait);
+                for (int i = 0; i < count; i++) {
+                    size_t index = static_cast<size_t>(events[i].data.u64 >> 32);
+                    ICMPLIB_SOCKET sock = static_cast<ICMPLIB_SOCKET>(events[i].data.u64 & 0xffffffff);
+                    if (index == 2) {
+                        uint64_t value;
+                        while (read(sock, &value, sizeof(value)) > 0) { }
+                        continue;
+                    }
+                    IPAddress::Type type = index ? IPAddress::Type::IPv6 : IPAddress::Type::IPv4;
+                    bool datagram = families[index].socket->IsDatagram();
+                    if (events[i].events & EPOLLERR) {
+                        ReceiveErrors(type, sock);
+                    }
+                    Receive(type, sock, datagram);
+                }
+                wait = Expire();
+            }
+        }
+
+        std::mutex mutex;
+        std::unordered_map<uint64_t, Pending> table;
+        std::unique_ptr<Inbox> inbox = std::make_unique<Inbox>();
+        std::vector<std::pair<Callback, Result>> completed;
+        std::priority_queue<Deadline> deadlines;
+        Family families[2];
+        uint16_t base;
+        // Echo requests of each family prebuilt with their checksum; Register copies one and stamps id/seq
+        const ICMPEcho::ICMPRequest templates[2] = { ICMPEcho::ICMPRequest(IPAddress::Type::IPv4, 0, 0), ICMPEcho::ICMPRequest(IPAddress::Type::IPv6, 0, 0) };
+        // Placeholder addresses of results that have none yet, built once instead of on every receive
+        const IPAddress wildcards[2] = { IPAddress(), IPAddress("::", IPAddress::Type::IPv6) };
+        uint32_t counter = 0;
+        uint64_t serial = 0;
+        SocketMode mode = SocketMode::Auto;
+        bool txtime = false;
+        bool txtimeHonored = true;
+        clockid_t txtimeClock = CLOCK_MONOTONIC;
+        uint32_t txtimePaced = 0;
+        uint32_t txtimeEarly = 0;
+        ICMPLIB_SOCKET poller;
+        ICMPLIB_SOCKET wakeup;
+        std::atomic<bool> running{ false };
+        std::thread receiver;
     };
+#endif
 
     using PingResult = ICMPEcho::Result;
     using PingResponseType = ICMPEcho::Result::ResponseType;
@@ -4,6 +4,9 @@ AsyncPinger pinger;
 WebResourceMonitor monitor;
 TCPClient client;
 
+// Обходы подсетей (Protocol 4): запись конфигурации -> флаг работы ее потока
+std::map<int, std::shared_ptr<std::atomic<bool>>> sweeps;
+
 static void handler(int s) {
     if (s == 2) // crtl+c
     {
@@ -14,6 +17,105 @@ static void handler(int s) {
     }
 }
 
+// Раз в минуту: сколько проверок пропустил регулятор, сколько раз и как долго они ждали
+// бюджета и сколько запросов было в полете одновременно
+static void report_governor()
+{
+    const std::pair<ProbeProtocol, const char*> protocols[] = {
+        { ProbeProtocol::Icmp, "ICMP" },
+        { ProbeProtocol::Http, "HTTP" },
+        { ProbeProtocol::Sweep, "Sweep" },
+    };
+    auto& governor = ProbeGovernor::instance();
+    for (const auto& [protocol, name] : protocols)
+    {
+        GovernorMetrics metrics = governor.metrics(protocol);
+        std::cout << "Probe budget " << name << ": admitted " << metrics.admitted
+            << ", throttled " << metrics.throttled << " (" << static_cast<uint64_t>(metrics.throttled_ms) << " ms)"
+            << ", in flight " << metrics.in_flight << ", peak " << metrics.peak_in_flight << std::endl;
+    }
+    GovernorMetrics total = governor.total_metrics();
+    std::cout << "Probe budget total: in flight " << total.in_flight << ", peak " << total.peak_in_flight
+        << ", dropped ping results " << pinger.dropped_completions() << std::endl;
+}
+
+// Host - диапазоны через запятую ("10.0.0.0/24,10.0.1.0/24"). Обход повторяется раз в интервал
+// в своем потоке; по итогу уходит одно сообщение со списком ответивших адресов
+static void start_sweep(int id, const std::string& ranges, int interval_minutes)
+{
+    auto sweeper = std::make_shared<SubnetSweeper>();
+    std::stringstream list(ranges);
+    std::string range{};
+    while (std::getline(list, range, ','))
+    {
+        range.erase(0, range.find_first_not_of(' '));
+        range.erase(range.find_last_not_of(' ') + 1);
+        if (!sweeper->add_range(range))
+        {
+            std::cerr << "Invalid or overlapping sweep range: " << range << " | skipped " << ranges << std::endl;
+            return;
+        }
+    }
+    if (sweeper->size() == 0)
+    {
+        return;
+    }
+
+    // Повторная запись с тем же Id заменяет прежний обход
+    auto active = std::make_shared<std::atomic<bool>>(true);
+    if (auto it = sweeps.find(id); it != sweeps.end())
+    {
+        *it->second = false;
+    }
+    sweeps[id] = active;
+
+    std::thread([sweeper, active, id, ranges, interval_minutes]() {
+        while (*active)
+        {
+            std::vector<std::string> alive{};
+            SubnetSweeper::Totals totals{};
+            try
+            {
+                // Колбэк вызывается только из этого потока; сброс active прерывает обход
+                totals = sweeper->run([&alive](const std::string& address, bool up, double) {
+                    if (up)
+                    {
+                        alive.push_back(address);
+                    }
+                    }, active.get());
+            }
+            catch (const std::exception& ex)
+            {
+                std::cerr << "Sweep error for " << ranges << ": " << ex.what() << std::endl;
+                break;
+            }
+            if (!*active)
+            {
+                break; // Обход заменен или убран из конфигурации, итог не отправляем
+            }
+
+            nlohmann::json obj{};
+            obj["Id"] = id; // int
+            obj["Host"] = ranges; // str
+            obj["Protocol"] = 4; // int
+            obj["Result"] = totals.alive > 0 ? "Success" : "Failed"; // str
+            obj["Alive"] = alive; // список ответивших адресов
+            obj["Sent"] = totals.sent;
+            obj["AliveCount"] = totals.alive;
+            obj["DeadCount"] = totals.dead;
+            if (client.isConnected())
+            {
+                client.send(obj.dump());
+            }
+
+            for (int i = 0; i < std::max(interval_minutes, 1) * 60 && *active; ++i)
+            {
+                std::this_thread::sleep_for(std::chrono::seconds(1));
+            }
+        }
+        }).detach();
+}
+
 int main()
 {
     
@@ -27,51 +129,29 @@ int main()
 
     // Устанавливаем колбэк функцию
     std::map<std::string, int> icmp_host_id; 
-    pinger.set_callback([&icmp_host_id](std::string host, std::vector<icmplib::PingResult> results) { 
-        std::cout << "[CALLBACK] Host: " << host << ", Response: ";
-        
-        bool success{false};
-        int c{0};
-        const auto& it = icmp_host_id.find(host); // not null
+    pinger.set_callback([&icmp_host_id](std::string host, const SeriesSummary& summary) { 
+        std::cout << "[CALLBACK] Host: " << host << ", received " << summary.received << "/" << summary.sent
+            << ", avg " << summary.avg_ms << " ms, loss " << summary.loss_percent << "%" << std::endl;
 
-        for (const auto& result : results) 
-        {
-            c++;
-            switch (result.response) {
-            case icmplib::PingResponseType::Success: 
-                {
-                //std::cout << "Success, time: " << result.delay << " ttl: " << static_cast<std::uint16_t>(result.ttl);
-                success = true;
-                nlohmann::json obj{};
-                obj["Id"] = it->second; // int
-                obj["Host"] = host; // str
-                obj["Protocol"] = 3; // int
-                obj["Result"] = "Success"; //str | Success / Failed
-                obj["Delay"] = result.delay; // int задержка
-                if (client.isConnected())
-                {
-                    client.send(obj.dump());
-                }
-                return;
-                }
-            }
-            //std::cout << std::endl;
-        }
+        const auto& it = icmp_host_id.find(host); // not null
 
-        if (!success)
+        nlohmann::json obj{};
+        obj["Id"] = it->second; // int
+        obj["Host"] = host; // str
+        obj["Protocol"] = 3; // int
+        obj["Result"] = summary.received > 0 ? "Success" : "Failed"; //str | Success / Failed
+        obj["Delay"] = summary.first_ms; // задержка первого ответа, как раньше; без ответа - первого запроса
+        obj["AvgDelay"] = summary.avg_ms; // средняя задержка серии
+        obj["MinDelay"] = summary.min_ms;
+        obj["MaxDelay"] = summary.max_ms;
+        obj["StdDev"] = summary.stddev_ms;
+        obj["Jitter"] = summary.jitter_ms;
+        obj["Loss"] = summary.loss_percent; // процент потерь
+        obj["Timeout"] = summary.timeout_ms; // таймаут запросов по истории RTT
+        if (client.isConnected())
         {
-            nlohmann::json obj{};
-            obj["Id"] = it->second; // int
-            obj["Host"] = host; // str
-            obj["Protocol"] = 3; // int
-            obj["Result"] = "Failed"; //str | Success / Failed
-            obj["Delay"] = results[0].delay; // задержка
-            if (client.isConnected())
-            {
-                client.send(obj.dump());
-            }
+            client.send(obj.dump());
         }
-
         });
 
     
@@ -118,6 +198,7 @@ int main()
             obj["ErrorMessage"] = response.error_message; // str
             obj["SslCertInfo"] = response.ssl_cert_info; // str
             obj["RedirectCount"] = response.redirect_count; // int
+            obj["Timeout"] = response.timeout_ms; // int, ms
             obj["Headers"] = response.headers; // str
             if (client.isConnected())
             {
@@ -132,11 +213,12 @@ int main()
     if (client.connect("127.0.0.1", 7777))
     {
         std::cout << "Connected to C# server" << std::endl;
-        std::cout << "Starting monitoring with immediate checks..." << std::endl;
-        monitor.start(); // Все хосты проверятся немедленно!
+        std::cout << "Starting monitoring with ramped first checks..." << std::endl;
+        monitor.start(); // Первые проверки разнесены по разгону, дальше - каждая в своей фазе интервала
 
         // Читаем ответы
         std::string response{};
+        auto next_report = std::chrono::steady_clock::now() + std::chrono::minutes(1);
         while (client.isConnected())
         {
             if (client.receive(response)) {
@@ -145,6 +227,10 @@ int main()
                 try
                 {
                     const auto& js_obj = nlohmann::json::parse(response);
+                    // ICMP хосты проверяются одним пакетом после разбора всего списка
+                    std::vector<std::string> icmp_hosts{};
+                    std::vector<std::pair<int, int>> icmp_settings{}; // Id и интервал
+                    std::set<int> sweep_ids{}; // Обходы из этой конфигурации, остальные останавливаются
                     for (const auto& object : js_obj)
                     {
                         // object
@@ -167,14 +253,45 @@ int main()
                         }
                         else if (Protocol == 3) // icmp
                         {
-                            icmp_host_id.emplace(host, id); // 5:22 утра
-                            pinger.add_address(host, std::chrono::minutes(IntervalMinutes));
+                            icmp_hosts.push_back(host);
+                            icmp_settings.emplace_back(id, IntervalMinutes);
+                        }
+                        else if (Protocol == 4) // обход подсетей ICMP, Host - диапазоны CIDR
+                        {
+                            sweep_ids.insert(id);
+                            start_sweep(id, host, IntervalMinutes);
                         }
                         else
                         {
                             std::cerr << "Unknown protocol: " << Protocol << " with " << host << " | skipped" << std::endl;
                         }
                     }
+
+                    for (auto it = sweeps.begin(); it != sweeps.end();)
+                    {
+                        if (sweep_ids.count(it->first) == 0)
+                        {
+                            *it->second = false;
+                            it = sweeps.erase(it);
+                        }
+                        else
+                        {
+                            ++it;
+                        }
+                    }
+
+                    std::vector<ParsedAddress> parsed{};
+                    classify_addresses(icmp_hosts, parsed);
+                    for (size_t i = 0; i < icmp_hosts.size(); ++i)
+                    {
+                        if (parsed[i].kind == AddressKind::Invalid)
+                        {
+                            std::cerr << "Invalid host: " << icmp_hosts[i] << " | skipped" << std::endl;
+                            continue;
+                        }
+                        icmp_host_id.emplace(icmp_hosts[i], icmp_settings[i].first); // 5:22 утра
+                        pinger.add_address(icmp_hosts[i], std::chrono::minutes(icmp_settings[i].second), SeriesPolicy::first_success()); // Результат - доступность, хватает первого ответа
+                    }
                 }
                 catch (const nlohmann::json::exception& ex)
                 {
@@ -193,6 +310,11 @@ int main()
             }
             
             pinger.update();
+            if (std::chrono::steady_clock::now() >= next_report)
+            {
+                report_governor();
+                next_report += std::chrono::minutes(1);
+            }
             std::this_thread::sleep_for(std::chrono::milliseconds(5));
         }
     }
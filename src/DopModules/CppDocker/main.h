@@ -7,5 +7,6 @@
 #include <unistd.h>
 #include "icmp.h"
 #include "http.h"
+#include "sweep.h"
 #include "tcp.h"
 #include "json.hpp"
\ No newline at end of file
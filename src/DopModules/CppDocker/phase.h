@@ -0,0 +1,78 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string_view>
+#include <algorithm>
+
+//    .       ,
+//    ,      
+//  ,      .   
+//       (),     
+class PhaseSpreader {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit PhaseSpreader(unsigned admissions_per_second = 200) : epoch_(Clock::now()) {
+        set_ramp_rate(admissions_per_second);
+    }
+
+    //        
+    void set_ramp_rate(unsigned admissions_per_second) {
+        step_ns_ = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::seconds(1)).count() / std::max(1u, admissions_per_second);
+    }
+
+    // FNV-1a  :       
+    static uint64_t hash(std::string_view id) {
+        uint64_t value = 14695981039346656037ull;
+        for (unsigned char c : id) {
+            value = (value ^ c) * 1099511628211ull;
+        }
+        return hash(value);
+    }
+
+    static uint64_t hash(uint64_t id) {
+        id += 0x9e3779b97f4a7c15ull;
+        id = (id ^ (id >> 30)) * 0xbf58476d1ce4e5b9ull;
+        id = (id ^ (id >> 27)) * 0x94d049bb133111ebull;
+        return id ^ (id >> 31);
+    }
+
+    //    :    
+    Clock::time_point first_run(Clock::time_point now) {
+        int64_t now_ns = since_epoch(now);
+        int64_t slot = next_slot_ns_.load(std::memory_order_relaxed);
+        int64_t start;
+        do {
+            start = std::max(slot, now_ns);
+        } while (!next_slot_ns_.compare_exchange_weak(slot, start + step_ns_.load(std::memory_order_relaxed), std::memory_order_relaxed));
+        return epoch_ + std::chrono::nanoseconds(start);
+    }
+
+    //  :    ,       
+    //  .            
+    //    interval
+    Clock::time_point next_run(uint64_t phase, Clock::duration interval, Clock::time_point last) const {
+        int64_t period = std::chrono::duration_cast<std::chrono::nanoseconds>(interval).count();
+        if (period <= 0) {
+            return last;
+        }
+        int64_t offset = static_cast<int64_t>((phase >> 11) % static_cast<uint64_t>(period));
+        int64_t earliest = since_epoch(last) + period / 2;
+        int64_t cycles = (earliest - offset + period - 1) / period;
+        if (earliest - offset < 0) {
+            cycles = 0;
+        }
+        return epoch_ + std::chrono::nanoseconds(offset + cycles * period);
+    }
+
+private:
+    int64_t since_epoch(Clock::time_point time) const {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(time - epoch_).count();
+    }
+
+    const Clock::time_point epoch_;
+    std::atomic<int64_t> step_ns_{ 0 };
+    std::atomic<int64_t> next_slot_ns_{ 0 };
+};
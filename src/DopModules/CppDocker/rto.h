@@ -0,0 +1,91 @@
+#pragma once
+
+#include <atomic>
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+
+//     RTT ,  RTO  TCP (RFC 6298):
+// SRTT  RTTVAR    1/8  1/4, RTO = SRTT + max(G, 4 * RTTVAR),
+//    RTO     .
+//   ,   .       ,
+//  SRTT  RTTVAR     
+class RtoEstimator {
+public:
+    RtoEstimator() = default;
+
+    //  -   (,      )
+    RtoEstimator(const RtoEstimator& other)
+        : state_(other.state_.load(std::memory_order_relaxed)), backoff_(other.backoff_.load(std::memory_order_relaxed)) {}
+
+    RtoEstimator& operator=(const RtoEstimator& other) {
+        state_.store(other.state_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        backoff_.store(other.backoff_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        return *this;
+    }
+
+    //  ; RTT  
+    void sample(double rtt_ms) {
+        float rtt = static_cast<float>(std::max(rtt_ms, 0.0));
+        uint64_t current = state_.load(std::memory_order_relaxed);
+        uint64_t next;
+        do {
+            float srtt = srtt_of(current);
+            float rttvar = rttvar_of(current);
+            if (srtt < 0) {
+                srtt = rtt;
+                rttvar = rtt / 2;
+            }
+            else {
+                rttvar = 0.75f * rttvar + 0.25f * std::fabs(srtt - rtt);
+                srtt = 0.875f * srtt + 0.125f * rtt;
+            }
+            next = pack(srtt, rttvar);
+        } while (!state_.compare_exchange_weak(current, next, std::memory_order_relaxed));
+        backoff_.store(0, std::memory_order_relaxed);
+    }
+
+    //    
+    void timeout() {
+        uint8_t backoff = backoff_.load(std::memory_order_relaxed);
+        if (backoff < max_backoff) {
+            backoff_.compare_exchange_strong(backoff, backoff + 1, std::memory_order_relaxed);
+        }
+    }
+
+    //       [floor_ms, ceiling_ms]
+    uint32_t timeout_ms(uint32_t floor_ms, uint32_t ceiling_ms) const {
+        uint64_t current = state_.load(std::memory_order_relaxed);
+        float srtt = srtt_of(current);
+        if (srtt < 0) {
+            return ceiling_ms;
+        }
+        double rto = srtt + std::max(granularity_ms, 4.0 * rttvar_of(current));
+        rto *= 1u << backoff_.load(std::memory_order_relaxed);
+        return static_cast<uint32_t>(std::clamp(std::ceil(rto), static_cast<double>(floor_ms), static_cast<double>(std::max(floor_ms, ceiling_ms))));
+    }
+
+    bool has_samples() const {
+        return srtt_of(state_.load(std::memory_order_relaxed)) >= 0;
+    }
+
+private:
+    static constexpr double granularity_ms = 1.0; //    curl - 
+    static constexpr uint8_t max_backoff = 6;
+
+    static constexpr uint64_t pack(float srtt, float rttvar) {
+        return (static_cast<uint64_t>(std::bit_cast<uint32_t>(srtt)) << 32) | std::bit_cast<uint32_t>(rttvar);
+    }
+
+    static float srtt_of(uint64_t state) {
+        return std::bit_cast<float>(static_cast<uint32_t>(state >> 32));
+    }
+
+    static float rttvar_of(uint64_t state) {
+        return std::bit_cast<float>(static_cast<uint32_t>(state));
+    }
+
+    std::atomic<uint64_t> state_{ pack(-1.0f, 0.0f) }; // SRTT < 0 -    
+    std::atomic<uint8_t> backoff_{ 0 };
+};
@@ -0,0 +1,502 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <deque>
+#include <chrono>
+#include <functional>
+#include <random>
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <charconv>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <arpa/inet.h>
+#include <linux/filter.h>
+#include <poll.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "governor.h"
+
+//    IPv4 -     .
+//      (   
+//    ),    -     
+// (SipHash    ),     RTT   
+//  .  -        .
+class SubnetSweeper {
+public:
+    using Clock = std::chrono::steady_clock;
+    // alive == false      ,    
+    using Callback = std::function<void(const std::string& address, bool alive, double rtt_ms)>;
+
+    struct Totals {
+        uint64_t sent = 0;
+        uint64_t alive = 0;
+        uint64_t dead = 0;
+    };
+
+    SubnetSweeper() {
+        std::random_device random;
+        key_[0] = (static_cast<uint64_t>(random()) << 32) | random();
+        key_[1] = (static_cast<uint64_t>(random()) << 32) | random();
+        identifier_ = static_cast<uint16_t>(random());
+    }
+
+    // "10.0.0.0/16"   ;   /30      broadcast .
+    // ,    , :     
+    //    ,  
+    bool add_range(const std::string& cidr) {
+        size_t slash = cidr.find('/');
+        std::string address = cidr.substr(0, slash);
+        int prefix = 32;
+        if (slash != std::string::npos) {
+            const char* begin = cidr.data() + slash + 1;
+            const char* end = cidr.data() + cidr.size();
+            auto [last, error] = std::from_chars(begin, end, prefix);
+            if (begin == end || error != std::errc() || last != end) {
+                return false;
+            }
+        }
+        in_addr parsed;
+        if (prefix < 0 || prefix > 32 || inet_pton(AF_INET, address.c_str(), &parsed) != 1) {
+            return false;
+        }
+
+        uint64_t size = 1ull << (32 - prefix);
+        uint32_t mask = prefix ? ~0u << (32 - prefix) : 0;
+        uint32_t first = ntohl(parsed.s_addr) & mask;
+        if (size >= 4) {
+            first++;
+            size -= 2;
+        }
+        for (const auto& range : ranges_) {
+            if (first < range.first + range.size && range.first < first + size) {
+                return false;
+            }
+        }
+        ranges_.push_back({ first, size, total_ });
+        total_ += size;
+        return true;
+    }
+
+    //   .     ProbeProtocol::Sweep
+    //  ProbeGovernor (  10000  );     
+    //  ProbeGovernor::instance().set_limits(ProbeProtocol::Sweep, ...)  set_total_limits
+    void set_rate(unsigned per_second) {
+        rate_ = std::max(1u, per_second);
+    }
+
+    //       
+    void set_timeout(std::chrono::milliseconds timeout) {
+        timeout_ = timeout;
+    }
+
+    uint64_t size() const {
+        return total_;
+    }
+
+    //     .    ,
+    //    ,       :
+    //   -   ,  -  .  running  ,  
+    //   ;       
+    Totals run(const Callback& callback, const std::atomic<bool>* running = nullptr) {
+        Totals totals;
+        if (total_ == 0) {
+            return totals;
+        }
+        open_socket();
+        seen_.assign((total_ + 63) / 64, 0);
+        sending_ = true;
+        aborted_ = false;
+        alive_ = 0;
+
+        std::thread sender([this, running, &totals]() {
+            totals.sent = send_all(running);
+            deadline_ = Clock::now() + timeout_;
+            sending_ = false;
+        });
+        try {
+            receive_loop(callback, running);
+        }
+        catch (...) {
+            //    :  ,    
+            aborted_ = true;
+            release_expired(Clock::time_point::max());
+            sender.join();
+            close(sock_);
+            sock_ = -1;
+            release_expired(Clock::time_point::max());
+            throw;
+        }
+        sender.join();
+        close(sock_);
+        sock_ = -1;
+        release_expired(Clock::time_point::max());
+
+        totals.alive = alive_;
+        if (cancelled(running)) {
+            return totals;
+        }
+        for (const auto& range : ranges_) {
+            for (uint64_t i = 0; i < range.size; ++i) {
+                uint64_t index = range.offset + i;
+                if (!(seen_[index / 64] & (1ull << (index % 64)))) {
+                    totals.dead++;
+                    callback(format(static_cast<uint32_t>(range.first + i)), false, 0);
+                }
+            }
+        }
+        seen_.clear();
+        seen_.shrink_to_fit();
+        return totals;
+    }
+
+private:
+    struct Range {
+        uint32_t first;  //     
+        uint64_t size;
+        uint64_t offset; //      
+    };
+
+    // -:          
+    struct EchoPacket {
+        uint8_t type;
+        uint8_t code;
+        uint16_t checksum;
+        uint16_t id;
+        uint16_t seq;
+        uint64_t sent;   //  ,  steady_clock
+        uint64_t cookie; // SipHash(, )   
+    };
+
+    //         
+    struct Pending {
+        Clock::time_point expires;
+        size_t count;
+    };
+
+    static constexpr size_t batch_size = 64;
+
+    bool cancelled(const std::atomic<bool>* running) const {
+        return aborted_ || (running && !running->load());
+    }
+
+    static std::string format(uint32_t address) {
+        in_addr value{ htonl(address) };
+        char text[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &value, text, sizeof(text));
+        return text;
+    }
+
+    static uint64_t now_ns() {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count());
+    }
+
+    static uint64_t rotl(uint64_t value, int bits) {
+        return (value << bits) | (value >> (64 - bits));
+    }
+
+    // SipHash-2-4   64- 
+    uint64_t cookie(uint32_t address, uint64_t sent) const {
+        uint64_t v0 = key_[0] ^ 0x736f6d6570736575ull;
+        uint64_t v1 = key_[1] ^ 0x646f72616e646f6dull;
+        uint64_t v2 = key_[0] ^ 0x6c7967656e657261ull;
+        uint64_t v3 = key_[1] ^ 0x7465646279746573ull;
+        auto round = [&]() {
+            v0 += v1; v1 = rotl(v1, 13); v1 ^= v0; v0 = rotl(v0, 32);
+            v2 += v3; v3 = rotl(v3, 16); v3 ^= v2;
+            v0 += v3; v3 = rotl(v3, 21); v3 ^= v0;
+            v2 += v1; v1 = rotl(v1, 17); v1 ^= v2; v2 = rotl(v2, 32);
+        };
+        const uint64_t words[] = { address, sent, static_cast<uint64_t>(16) << 56 };
+        for (uint64_t word : words) {
+            v3 ^= word;
+            round();
+            round();
+            v0 ^= word;
+        }
+        v2 ^= 0xff;
+        for (int i = 0; i < 4; ++i) {
+            round();
+        }
+        return v0 ^ v1 ^ v2 ^ v3;
+    }
+
+    static uint16_t checksum(const void* data, size_t size) {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        uint32_t sum = 0;
+        for (size_t i = 0; i + 1 < size; i += 2) {
+            uint16_t word;
+            std::memcpy(&word, bytes + i, sizeof(word));
+            sum += word;
+        }
+        if (size & 1) {
+            sum += bytes[size - 1];
+        }
+        sum = (sum >> 16) + (sum & 0xffff);
+        sum += sum >> 16;
+        return static_cast<uint16_t>(~sum);
+    }
+
+    //   ping  (   ),  raw
+    //   BPF    
+    void open_socket() {
+        datagram_ = true;
+        sock_ = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, IPPROTO_ICMP);
+        if (sock_ < 0) {
+            datagram_ = false;
+            sock_ = socket(AF_INET, SOCK_RAW | SOCK_CLOEXEC, IPPROTO_ICMP);
+            if (sock_ < 0) {
+                throw std::runtime_error("Cannot create ICMP socket for sweep");
+            }
+            sock_filter code[] = {
+                BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, 0),
+                BPF_STMT(BPF_LD | BPF_B | BPF_IND, 0),
+                BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0, 0, 3),
+                BPF_STMT(BPF_LD | BPF_H | BPF_IND, 4),
+                BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ntohs(identifier_), 0, 1),
+                BPF_STMT(BPF_RET | BPF_K, 0xffffffff),
+                BPF_STMT(BPF_RET | BPF_K, 0),
+            };
+            sock_fprog program = { static_cast<unsigned short>(sizeof(code) / sizeof(code[0])), code };
+            setsockopt(sock_, SOL_SOCKET, SO_ATTACH_FILTER, &program, sizeof(program));
+        }
+        //        ,    
+        int buffer = 4 << 20;
+        setsockopt(sock_, SOL_SOCKET, SO_RCVBUF, &buffer, sizeof(buffer));
+        fcntl(sock_, F_SETFL, fcntl(sock_, F_GETFL, 0) | O_NONBLOCK);
+    }
+
+    //     ,       
+    bool index_of(uint32_t address, uint64_t& index) const {
+        for (const auto& range : ranges_) {
+            if (address - range.first < range.size) {
+                index = range.offset + (address - range.first);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    uint32_t address_at(uint64_t index) const {
+        auto it = std::upper_bound(ranges_.begin(), ranges_.end(), index, [](uint64_t value, const Range& range) {
+            return value < range.offset;
+        });
+        --it;
+        return static_cast<uint32_t>(it->first + (index - it->offset));
+    }
+
+    //   0..total_-1   x -> a*x + c    
+    // (a = 1 mod 4, c ),    
+    uint64_t send_all(const std::atomic<bool>* running) {
+        std::mt19937_64 random{ std::random_device{}() };
+        uint64_t modulus = 2;
+        while (modulus < total_) {
+            modulus <<= 1;
+        }
+        uint64_t mask = modulus - 1;
+        uint64_t multiplier = ((random() << 2) | 1) & mask;
+        if (multiplier == 1 && modulus > 4) {
+            multiplier = 5;
+        }
+        uint64_t increment = (random() & mask) | 1;
+        uint64_t x = random() & mask;
+
+        EchoPacket packets[batch_size];
+        sockaddr_in targets[batch_size];
+        iovec vectors[batch_size];
+        mmsghdr messages[batch_size];
+
+        auto start = Clock::now();
+        uint64_t sent = 0;
+        uint64_t step = 0;
+        while (step < modulus && !cancelled(running)) {
+            size_t count = 0;
+            //  ,       ,  
+            //  ;     ,     RTT
+            auto due = start + std::chrono::nanoseconds(sent * 1000000000ull / rate_);
+            std::this_thread::sleep_until(due);
+            //   ,      10 
+            size_t limit = ProbeGovernor::instance().acquire(ProbeProtocol::Sweep, std::clamp<size_t>(rate_ / 100, 1, batch_size), running);
+            if (cancelled(running)) {
+                ProbeGovernor::instance().release(ProbeProtocol::Sweep, limit);
+                break;
+            }
+            while (count < limit && step < modulus) {
+                x = (multiplier * x + increment) & mask;
+                step++;
+                if (x >= total_) {
+                    continue;
+                }
+                uint32_t address = address_at(x);
+                EchoPacket& packet = packets[count];
+                packet = {};
+                packet.type = 8;
+                packet.id = identifier_;
+                packet.seq = htons(static_cast<uint16_t>(x));
+                packet.sent = now_ns();
+                packet.cookie = cookie(address, packet.sent);
+                packet.checksum = checksum(&packet, sizeof(packet));
+
+                targets[count] = {};
+                targets[count].sin_family = AF_INET;
+                targets[count].sin_addr.s_addr = htonl(address);
+                vectors[count] = { &packet, sizeof(packet) };
+                messages[count] = {};
+                messages[count].msg_hdr.msg_name = &targets[count];
+                messages[count].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+                messages[count].msg_hdr.msg_iov = &vectors[count];
+                messages[count].msg_hdr.msg_iovlen = 1;
+                count++;
+            }
+
+            size_t done = 0;
+            while (done < count) {
+                int result = sendmmsg(sock_, messages + done, static_cast<unsigned>(count - done), 0);
+                if (result > 0) {
+                    done += static_cast<size_t>(result);
+                }
+                else if (errno == EAGAIN || errno == ENOBUFS) {
+                    pollfd fd = { sock_, POLLOUT, 0 };
+                    poll(&fd, 1, 10);
+                }
+                else {
+                    // ,    ,  
+                    done++;
+                }
+            }
+            //     ,  -    
+            if (limit > count) {
+                ProbeGovernor::instance().release(ProbeProtocol::Sweep, limit - count);
+            }
+            if (count > 0) {
+                std::lock_guard<std::mutex> lock(pending_mutex_);
+                pending_.push_back({ Clock::now() + timeout_, count });
+                outstanding_ += count;
+            }
+            sent += count;
+        }
+        return sent;
+    }
+
+    void receive_loop(const Callback& callback, const std::atomic<bool>* running) {
+        uint8_t buffers[batch_size][128];
+        sockaddr_in sources[batch_size];
+        iovec vectors[batch_size];
+        mmsghdr messages[batch_size];
+
+        while ((sending_ || Clock::now() < deadline_) && !cancelled(running)) {
+            //     :       
+            release_expired(Clock::now());
+            pollfd fd = { sock_, POLLIN, 0 };
+            if (poll(&fd, 1, 20) <= 0) {
+                continue;
+            }
+            for (size_t i = 0; i < batch_size; ++i) {
+                vectors[i] = { buffers[i], sizeof(buffers[i]) };
+                messages[i] = {};
+                messages[i].msg_hdr.msg_name = &sources[i];
+                messages[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+                messages[i].msg_hdr.msg_iov = &vectors[i];
+                messages[i].msg_hdr.msg_iovlen = 1;
+            }
+            int count = recvmmsg(sock_, messages, batch_size, MSG_DONTWAIT, nullptr);
+            uint64_t received = now_ns();
+            for (int i = 0; i < count; ++i) {
+                handle_reply(buffers[i], messages[i].msg_len, ntohl(sources[i].sin_addr.s_addr), received, callback);
+            }
+        }
+    }
+
+    //   ;      
+    void handle_reply(const uint8_t* data, size_t size, uint32_t source, uint64_t received, const Callback& callback) {
+        if (!datagram_) {
+            if (size < sizeof(iphdr)) {
+                return;
+            }
+            size_t header = static_cast<size_t>(data[0] & 0x0f) * 4;
+            if (size < header) {
+                return;
+            }
+            data += header;
+            size -= header;
+        }
+        if (size < sizeof(EchoPacket)) {
+            return;
+        }
+        EchoPacket reply;
+        std::memcpy(&reply, data, sizeof(reply));
+        if (reply.type != 0 || (!datagram_ && reply.id != identifier_) || reply.cookie != cookie(source, reply.sent)) {
+            return;
+        }
+        uint64_t index;
+        if (!index_of(source, index)) {
+            return;
+        }
+        uint64_t bit = 1ull << (index % 64);
+        if (seen_[index / 64] & bit) {
+            return;
+        }
+        seen_[index / 64] |= bit;
+        alive_++;
+        bool held;
+        {
+            //         
+            std::lock_guard<std::mutex> lock(pending_mutex_);
+            held = outstanding_ > 0;
+            if (held) {
+                outstanding_--;
+                answered_++;
+            }
+        }
+        if (held) {
+            ProbeGovernor::instance().release(ProbeProtocol::Sweep);
+        }
+        callback(format(source), true, static_cast<double>(received - reply.sent) / 1e6);
+    }
+
+    //      .     
+    //        :     
+    void release_expired(Clock::time_point now) {
+        size_t count = 0;
+        {
+            std::lock_guard<std::mutex> lock(pending_mutex_);
+            while (!pending_.empty() && pending_.front().expires <= now) {
+                size_t answered = std::min<uint64_t>(answered_, pending_.front().count);
+                answered_ -= answered;
+                count += pending_.front().count - answered;
+                pending_.pop_front();
+            }
+            outstanding_ -= std::min<uint64_t>(outstanding_, count);
+        }
+        if (count > 0) {
+            ProbeGovernor::instance().release(ProbeProtocol::Sweep, count);
+        }
+    }
+
+    std::vector<Range> ranges_;
+    uint64_t total_ = 0;
+    unsigned rate_ = 10000;
+    std::chrono::milliseconds timeout_{ 1000 };
+
+    uint64_t key_[2];
+    uint16_t identifier_;
+    int sock_ = -1;
+    bool datagram_ = true;
+    std::atomic<bool> sending_{ false };
+    std::atomic<bool> aborted_{ false }; //     
+    Clock::time_point deadline_;
+    std::vector<uint64_t> seen_; //   :   
+    uint64_t alive_ = 0;
+    std::mutex pending_mutex_;
+    std::deque<Pending> pending_; //    
+    uint64_t answered_ = 0;       // ,     
+    uint64_t outstanding_ = 0;    //   ,   
+};
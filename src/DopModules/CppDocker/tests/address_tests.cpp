@@ -0,0 +1,85 @@
+﻿// Разбор адресов без std::regex: IPv4, IPv6, имена хостов и перевод в sockaddr
+#include <string>
+#include <vector>
+#include "address.h"
+#include "check.h"
+
+static void test_ipv4() {
+    uint8_t bytes[16] = {};
+    CHECK(parse_ipv4("192.168.0.1", bytes));
+    CHECK(bytes[0] == 192 && bytes[1] == 168 && bytes[2] == 0 && bytes[3] == 1);
+    CHECK(parse_ipv4("0.0.0.0", bytes));
+    CHECK(!parse_ipv4("256.1.1.1", bytes));
+    CHECK(!parse_ipv4("01.2.3.4", bytes)); // Ведущий ноль: inet_aton прочел бы восьмеричное число
+    CHECK(!parse_ipv4("1.2.3", bytes));
+    CHECK(!parse_ipv4("1.2.3.4.", bytes));
+    CHECK(!parse_ipv4("1.2.3.4 ", bytes));
+    CHECK(!parse_ipv4("", bytes));
+}
+
+static void test_ipv6() {
+    uint8_t bytes[16] = {};
+    CHECK(parse_ipv6("::1", bytes));
+    CHECK(bytes[0] == 0 && bytes[15] == 1);
+    CHECK(parse_ipv6("::", bytes));
+    CHECK(parse_ipv6("2001:db8::1", bytes));
+    CHECK(bytes[0] == 0x20 && bytes[1] == 0x01 && bytes[2] == 0x0d && bytes[3] == 0xb8 && bytes[15] == 1);
+    CHECK(parse_ipv6("1:2:3:4:5:6:7:8", bytes));
+    CHECK(bytes[14] == 0 && bytes[15] == 8);
+    CHECK(parse_ipv6("::ffff:10.0.0.1", bytes));
+    CHECK(bytes[10] == 0xff && bytes[11] == 0xff && bytes[12] == 10 && bytes[15] == 1);
+
+    CHECK(!parse_ipv6("1::2::3", bytes));
+    CHECK(!parse_ipv6(":1::2", bytes));
+    CHECK(!parse_ipv6("1:2:3:4:5:6:7:8:9", bytes));
+    CHECK(!parse_ipv6("1:2:3:4::5:6:7:8", bytes)); // "::" должно заменять хотя бы одну группу
+    CHECK(!parse_ipv6("12345::1", bytes));
+    CHECK(!parse_ipv6("1:", bytes));
+    CHECK(!parse_ipv6("g::1", bytes));
+}
+
+static void test_hostname() {
+    CHECK(is_hostname("ya.ru"));
+    CHECK(is_hostname("ya.ru."));
+    CHECK(is_hostname("_srv.internal-zone.local"));
+    CHECK(is_hostname("localhost"));
+    CHECK(!is_hostname("10.0.0.256")); // Числовая последняя метка - неверный IPv4, а не имя
+    CHECK(!is_hostname("-ya.ru"));
+    CHECK(!is_hostname("ya-.ru"));
+    CHECK(!is_hostname("ya..ru"));
+    CHECK(!is_hostname("ya ru"));
+    CHECK(!is_hostname(std::string(64, 'a') + ".ru"));
+    CHECK(!is_hostname(""));
+}
+
+static void test_classify() {
+    CHECK(classify_address("8.8.8.8").kind == AddressKind::IPv4);
+    CHECK(classify_address("fe80::1").kind == AddressKind::IPv6);
+    CHECK(classify_address("example.com").kind == AddressKind::Hostname);
+    CHECK(classify_address("300.0.0.1").kind == AddressKind::Invalid);
+    CHECK(classify_address("not a host").kind == AddressKind::Invalid);
+
+    std::vector<ParsedAddress> parsed;
+    CHECK(classify_addresses({ "1.1.1.1", "bad host", "::1", "ya.ru" }, parsed) == 3);
+    CHECK(parsed.size() == 4 && parsed[1].kind == AddressKind::Invalid && parsed[2].family() == AF_INET6);
+}
+
+static void test_to_sockaddr() {
+    sockaddr_storage storage;
+    CHECK(classify_address("10.1.2.3").to_sockaddr(storage, 53) == sizeof(sockaddr_in));
+    auto* v4 = reinterpret_cast<sockaddr_in*>(&storage);
+    CHECK(v4->sin_family == AF_INET && ntohs(v4->sin_port) == 53 && ntohl(v4->sin_addr.s_addr) == 0x0a010203);
+
+    CHECK(classify_address("::1").to_sockaddr(storage) == sizeof(sockaddr_in6));
+    auto* v6 = reinterpret_cast<sockaddr_in6*>(&storage);
+    CHECK(v6->sin6_family == AF_INET6 && v6->sin6_port == 0 && v6->sin6_addr.s6_addr[15] == 1);
+}
+
+int main() {
+    test_ipv4();
+    test_ipv6();
+    test_hostname();
+    test_classify();
+    test_to_sockaddr();
+    return check_result("address_tests");
+}
@@ -0,0 +1,24 @@
+﻿#pragma once
+
+#include <iostream>
+
+// Проверка теста: провал печатается с местом в файле и не прерывает остальные проверки
+inline int check_failures = 0;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #condition ") failed" << std::endl; \
+            check_failures++; \
+        } \
+    } while (0)
+
+// Итог для кода возврата main
+inline int check_result(const char* suite) {
+    if (check_failures > 0) {
+        std::cerr << suite << ": " << check_failures << " check(s) failed" << std::endl;
+        return 1;
+    }
+    std::cout << suite << ": all checks passed" << std::endl;
+    return 0;
+}
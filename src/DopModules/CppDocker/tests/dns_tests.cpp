@@ -0,0 +1,298 @@
+﻿// DnsResolver против заглушки DNS сервера на 127.0.0.1: ответ по UDP, усеченный ответ
+// с повтором по TCP, NXDOMAIN и сервер, который не отвечает; разбор списка серверов и предел
+// запросов в работе
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <future>
+#include <chrono>
+#include <cstring>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+#include "dns.h"
+#include "check.h"
+
+// Зона заглушки:
+//   a.test   - A 10.0.0.1, AAAA нет
+//   v6.test  - A 10.0.0.2 и AAAA ::2
+//   big.test - по UDP усеченный ответ без записей, по TCP 40 записей A
+//   drop.test - запрос остается без ответа
+//   остальное - NXDOMAIN
+class StubServer {
+public:
+    StubServer() {
+        // TCP слушает тот же порт, что и UDP; если он занят, берем другой
+        for (int attempt = 0; attempt < 10 && port_ == 0; ++attempt) {
+            udp_ = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+            sockaddr_in address{};
+            address.sin_family = AF_INET;
+            address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            socklen_t length = sizeof(address);
+            if (bind(udp_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 ||
+                getsockname(udp_, reinterpret_cast<sockaddr*>(&address), &length) < 0) {
+                close(udp_);
+                continue;
+            }
+            listener_ = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            int enable = 1;
+            setsockopt(listener_, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+            if (bind(listener_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 || listen(listener_, 16) < 0) {
+                close(listener_);
+                close(udp_);
+                continue;
+            }
+            port_ = ntohs(address.sin_port);
+        }
+        if (port_ != 0) {
+            thread_ = std::thread(&StubServer::run, this);
+        }
+    }
+
+    ~StubServer() {
+        running_ = false;
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+        for (int fd : clients_) {
+            close(fd);
+        }
+        if (port_ != 0) {
+            close(listener_);
+            close(udp_);
+        }
+    }
+
+    uint16_t port() const {
+        return port_;
+    }
+
+    std::atomic<int> udp_queries{ 0 };
+    std::atomic<int> tcp_queries{ 0 };
+
+private:
+    void run() {
+        while (running_) {
+            std::vector<pollfd> fds = { { udp_, POLLIN, 0 }, { listener_, POLLIN, 0 } };
+            for (int fd : clients_) {
+                fds.push_back({ fd, POLLIN, 0 });
+            }
+            if (poll(fds.data(), fds.size(), 20) <= 0) {
+                continue;
+            }
+            if (fds[0].revents & POLLIN) {
+                uint8_t query[512];
+                sockaddr_storage from;
+                socklen_t length = sizeof(from);
+                ssize_t size = recvfrom(udp_, query, sizeof(query), 0, reinterpret_cast<sockaddr*>(&from), &length);
+                std::vector<uint8_t> reply;
+                if (size > 0 && build(query, static_cast<size_t>(size), false, reply)) {
+                    sendto(udp_, reply.data(), reply.size(), 0, reinterpret_cast<sockaddr*>(&from), length);
+                }
+            }
+            if (fds[1].revents & POLLIN) {
+                int client = accept(listener_, nullptr, nullptr);
+                if (client >= 0) {
+                    clients_.push_back(client);
+                }
+            }
+            for (size_t i = 2; i < fds.size(); ++i) {
+                if (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+                    serve_tcp(fds[i].fd);
+                }
+            }
+        }
+    }
+
+    // Одно сообщение с двухбайтовой длиной; закрытое соединение убирается из списка
+    void serve_tcp(int fd) {
+        uint8_t header[2];
+        uint8_t query[512];
+        bool ok = recv(fd, header, 2, MSG_WAITALL) == 2;
+        size_t size = ok ? (static_cast<size_t>(header[0]) << 8 | header[1]) : 0;
+        ok = ok && size <= sizeof(query) && recv(fd, query, size, MSG_WAITALL) == static_cast<ssize_t>(size);
+        std::vector<uint8_t> reply;
+        if (ok && build(query, size, true, reply)) {
+            uint8_t length[2] = { static_cast<uint8_t>(reply.size() >> 8), static_cast<uint8_t>(reply.size()) };
+            send(fd, length, 2, MSG_NOSIGNAL);
+            send(fd, reply.data(), reply.size(), MSG_NOSIGNAL);
+        }
+        if (!ok) {
+            close(fd);
+            clients_.erase(std::find(clients_.begin(), clients_.end(), fd));
+        }
+    }
+
+    // false - запрос остается без ответа
+    bool build(const uint8_t* query, size_t size, bool tcp, std::vector<uint8_t>& reply) {
+        if (size < 12) {
+            return false;
+        }
+        std::string name;
+        size_t position = 12;
+        while (position < size && query[position] != 0) {
+            size_t label = query[position];
+            if (!name.empty()) {
+                name += '.';
+            }
+            name.append(reinterpret_cast<const char*>(query + position + 1), std::min(label, size - position - 1));
+            position += label + 1;
+        }
+        size_t question_end = position + 5;
+        if (question_end > size) {
+            return false;
+        }
+        uint16_t type = static_cast<uint16_t>(query[position + 1] << 8 | query[position + 2]);
+        (tcp ? tcp_queries : udp_queries)++;
+
+        std::vector<std::vector<uint8_t>> records;
+        uint16_t flags = 0x8180;
+        if (name == "drop.test") {
+            return false;
+        }
+        else if (name == "a.test" || name == "v6.test") {
+            if (type == 1) {
+                records.push_back({ 10, 0, 0, static_cast<uint8_t>(name == "a.test" ? 1 : 2) });
+            }
+            else if (type == 28 && name == "v6.test") {
+                std::vector<uint8_t> address(16, 0);
+                address[15] = 2;
+                records.push_back(address);
+            }
+        }
+        else if (name == "big.test") {
+            if (!tcp) {
+                flags |= 0x0200; // TC
+            }
+            else if (type == 1) {
+                for (uint8_t i = 1; i <= 40; ++i) {
+                    records.push_back({ 10, 1, 0, i });
+                }
+            }
+        }
+        else {
+            flags |= 3; // NXDOMAIN
+        }
+
+        reply.assign(query, query + 2);
+        reply.push_back(static_cast<uint8_t>(flags >> 8));
+        reply.push_back(static_cast<uint8_t>(flags));
+        reply.insert(reply.end(), { 0, 1, 0, static_cast<uint8_t>(records.size()), 0, 0, 0, 0 });
+        reply.insert(reply.end(), query + 12, query + question_end);
+        for (const auto& record : records) {
+            uint16_t record_type = record.size() == 4 ? 1 : 28;
+            reply.insert(reply.end(), { 0xc0, 0x0c, 0, static_cast<uint8_t>(record_type), 0, 1, 0, 0, 0, 60, 0, static_cast<uint8_t>(record.size()) });
+            reply.insert(reply.end(), record.begin(), record.end());
+        }
+        return true;
+    }
+
+    int udp_ = -1;
+    int listener_ = -1;
+    uint16_t port_ = 0;
+    std::vector<int> clients_;
+    std::atomic<bool> running_{ true };
+    std::thread thread_;
+};
+
+static DnsAnswer resolve(DnsResolver& resolver, const std::string& host) {
+    std::promise<DnsAnswer> promise;
+    auto answer = promise.get_future();
+    resolver.resolve(host, [&promise](DnsAnswer result) { promise.set_value(std::move(result)); });
+    return answer.get();
+}
+
+static void test_udp_answer(DnsResolver& resolver) {
+    DnsAnswer answer = resolve(resolver, "a.test");
+    CHECK(!answer.transient);
+    CHECK(answer.addresses.size() == 1 && answer.addresses[0].address == "10.0.0.1" && answer.addresses[0].family == AF_INET);
+    CHECK(answer.ttl == std::chrono::seconds(60));
+
+    // Запросы A и AAAA идут параллельно, IPv4 в ответе первым
+    answer = resolve(resolver, "v6.test");
+    CHECK(answer.addresses.size() == 2 && answer.addresses[0].address == "10.0.0.2" && answer.addresses[1].address == "::2");
+}
+
+static void test_truncated_answer_over_tcp(DnsResolver& resolver, const StubServer& server) {
+    int tcp_before = server.tcp_queries;
+    DnsAnswer answer = resolve(resolver, "big.test");
+    CHECK(!answer.transient);
+    CHECK(answer.addresses.size() == 40);
+    CHECK(server.tcp_queries > tcp_before);
+}
+
+// Имени нет: ответ окончательный, а не сбой сервера
+static void test_nxdomain(DnsResolver& resolver) {
+    DnsAnswer answer = resolve(resolver, "missing.test");
+    CHECK(!answer.transient);
+    CHECK(answer.addresses.empty());
+}
+
+// Сервер молчит: после таймаута ответ помечен как временный
+static void test_silent_server(DnsResolver& resolver) {
+    auto start = std::chrono::steady_clock::now();
+    DnsAnswer answer = resolve(resolver, "drop.test");
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    CHECK(answer.transient);
+    CHECK(answer.addresses.empty());
+    CHECK(elapsed >= std::chrono::milliseconds(250) && elapsed < std::chrono::seconds(3));
+}
+
+// Имя занимает два запроса (A и AAAA): сверх max_queries имена сразу получают временную
+// ошибку, остальные доходят до таймаута
+static void test_query_limit(DnsResolver& resolver) {
+    const int names = 140;
+    std::atomic<int> answered{ 0 };
+    std::atomic<int> rejected{ 0 };
+    std::promise<void> all;
+    for (int i = 0; i < names; ++i) {
+        resolver.resolve("drop.test", [&](DnsAnswer answer) {
+            if (answer.transient && !answer.error.empty()) {
+                rejected++;
+            }
+            if (++answered == names) {
+                all.set_value();
+            }
+        });
+    }
+    CHECK(all.get_future().wait_for(std::chrono::seconds(3)) == std::future_status::ready);
+    CHECK(rejected == names - 128);
+
+    // Места освободились, следующее имя снова разрешается
+    CHECK(!resolve(resolver, "a.test").addresses.empty());
+}
+
+// Ошибочный список не заменяет уже заданные серверы
+static void test_nameserver_validation(DnsResolver& resolver) {
+    CHECK(!resolver.set_nameservers({}));
+    CHECK(!resolver.set_nameservers({ "127.0.0.1:0" }));
+    CHECK(!resolver.set_nameservers({ "127.0.0.1:65536" }));
+    CHECK(!resolver.set_nameservers({ "127.0.0.1:53x" }));
+    CHECK(!resolver.set_nameservers({ "127.0.0.1", "not-an-address" }));
+    CHECK(!resolve(resolver, "a.test").addresses.empty());
+}
+
+int main() {
+    StubServer server;
+    if (server.port() == 0) {
+        std::cerr << "Cannot bind the stub DNS server" << std::endl;
+        return 1;
+    }
+
+    DnsResolver resolver;
+    CHECK(resolver.set_nameservers({ "127.0.0.1:" + std::to_string(server.port()) }));
+    resolver.set_timeout(std::chrono::milliseconds(300), 1);
+
+    test_udp_answer(resolver);
+    test_truncated_answer_over_tcp(resolver, server);
+    test_nxdomain(resolver);
+    test_silent_server(resolver);
+    test_query_limit(resolver);
+    test_nameserver_validation(resolver);
+    return check_result("dns_tests");
+}
@@ -0,0 +1,53 @@
+﻿// Разнесение проверок: места разгона для новых целей и постоянная фаза внутри интервала
+#include <chrono>
+#include "phase.h"
+#include "check.h"
+
+using Clock = PhaseSpreader::Clock;
+using std::chrono::milliseconds;
+
+// Новые цели получают места через 1/темп разгона, но не раньше текущего момента
+static void test_ramp() {
+    PhaseSpreader phases(10);
+    Clock::time_point now = Clock::now();
+    Clock::time_point first = phases.first_run(now);
+    Clock::time_point second = phases.first_run(now);
+    CHECK(second - first == milliseconds(100));
+    CHECK(phases.first_run(now + std::chrono::seconds(10)) == now + std::chrono::seconds(10));
+}
+
+static void test_hash() {
+    CHECK(PhaseSpreader::hash("10.0.0.1") != PhaseSpreader::hash("10.0.0.2"));
+    CHECK(PhaseSpreader::hash("10.0.0.1") == PhaseSpreader::hash("10.0.0.1"));
+    CHECK(PhaseSpreader::hash(uint64_t{ 1 }) != PhaseSpreader::hash(uint64_t{ 2 }));
+}
+
+static void test_next_run() {
+    PhaseSpreader phases;
+    Clock::time_point now = Clock::now();
+    Clock::duration interval = std::chrono::minutes(1);
+    uint64_t phase = PhaseSpreader::hash("10.0.0.1");
+
+    // Первая проверка после разгона - не раньше половины интервала и не позже полутора
+    Clock::time_point next = phases.next_run(phase, interval, now);
+    CHECK(next >= now + interval / 2);
+    CHECK(next < now + interval / 2 + interval);
+
+    // Дальше - ровно через интервал, даже если проверка началась с опозданием
+    Clock::time_point after = phases.next_run(phase, interval, next);
+    CHECK(after - next == interval);
+    CHECK(phases.next_run(phase, interval, next + milliseconds(1500)) == after);
+
+    // Фаза не зависит от времени прошлой проверки
+    Clock::time_point other = phases.next_run(phase, interval, now + milliseconds(12345));
+    CHECK((other - next) % interval == Clock::duration::zero());
+
+    CHECK(phases.next_run(phase, Clock::duration::zero(), now) == now);
+}
+
+int main() {
+    test_ramp();
+    test_hash();
+    test_next_run();
+    return check_result("phase_tests");
+}
@@ -0,0 +1,55 @@
+﻿// Таймаут по истории RTT (RFC 6298): сглаживание, удвоение после потерь и границы
+#include "rto.h"
+#include "check.h"
+
+static void test_without_samples() {
+    RtoEstimator rto;
+    CHECK(!rto.has_samples());
+    CHECK(rto.timeout_ms(50, 1000) == 1000); // Без замеров - верхняя граница
+}
+
+static void test_first_sample() {
+    // SRTT = 100, RTTVAR = 50, RTO = 100 + 4 * 50
+    RtoEstimator rto;
+    rto.sample(100);
+    CHECK(rto.has_samples());
+    CHECK(rto.timeout_ms(50, 1000) == 300);
+    CHECK(rto.timeout_ms(50, 250) == 250);
+    CHECK(rto.timeout_ms(400, 1000) == 400);
+}
+
+static void test_backoff() {
+    RtoEstimator rto;
+    rto.sample(100);
+    rto.timeout();
+    CHECK(rto.timeout_ms(50, 1000) == 600);
+    rto.timeout();
+    CHECK(rto.timeout_ms(50, 5000) == 1200);
+    for (int i = 0; i < 20; ++i) {
+        rto.timeout();
+    }
+    CHECK(rto.timeout_ms(50, 100000) == 300 * 64); // Удвоение ограничено
+
+    // Успешный замер сбрасывает удвоение
+    rto.sample(100);
+    CHECK(rto.timeout_ms(50, 1000) == 250); // SRTT 100, RTTVAR 37.5
+}
+
+static void test_steady_samples() {
+    RtoEstimator rto;
+    for (int i = 0; i < 50; ++i) {
+        rto.sample(100);
+    }
+    CHECK(rto.timeout_ms(50, 1000) == 101); // RTTVAR сошелся к нулю, остается гранулярность таймеров
+
+    RtoEstimator copy = rto;
+    CHECK(copy.timeout_ms(50, 1000) == 101);
+}
+
+int main() {
+    test_without_samples();
+    test_first_sample();
+    test_backoff();
+    test_steady_samples();
+    return check_result("rto_tests");
+}
@@ -0,0 +1,43 @@
+﻿// Правила серий: когда серия эхо-запросов может закончиться раньше max_count
+#include "icmp.h"
+#include "check.h"
+
+static void test_fixed() {
+    SeriesPolicy policy = SeriesPolicy::fixed(3);
+    CHECK(!policy.satisfied(2, 2));
+    CHECK(policy.satisfied(3, 0));
+}
+
+static void test_first_success() {
+    SeriesPolicy policy = SeriesPolicy::first_success(5);
+    CHECK(!policy.satisfied(0, 0));
+    CHECK(!policy.satisfied(4, 0));
+    CHECK(policy.satisfied(1, 1));
+    CHECK(policy.satisfied(5, 0));
+}
+
+// Два успеха из пяти: после четырех потерь набрать их уже нельзя
+static void test_until_successes() {
+    SeriesPolicy policy = SeriesPolicy::until_successes(2, 5);
+    CHECK(!policy.satisfied(1, 1));
+    CHECK(policy.satisfied(2, 2));
+    CHECK(!policy.satisfied(3, 0));
+    CHECK(policy.satisfied(4, 0));
+}
+
+static void test_loss_bound() {
+    SeriesPolicy policy = SeriesPolicy::loss_bound(0.2, 16);
+    CHECK(!policy.satisfied(2, 2));  // Меньше min_count
+    CHECK(!policy.satisfied(3, 3));  // Интервал Уилсона при 0% потерь еще шире 0.2
+    CHECK(!policy.satisfied(5, 3));
+    CHECK(policy.satisfied(10, 10));
+    CHECK(policy.satisfied(16, 8));  // Граница серии
+}
+
+int main() {
+    test_fixed();
+    test_first_success();
+    test_until_successes();
+    test_loss_bound();
+    return check_result("series_policy_tests");
+}
@@ -0,0 +1,78 @@
+﻿// Колесо таймеров: выдача в срок, отмена, переиспользование узлов и каскад с верхних уровней
+#include <vector>
+#include <chrono>
+#include "timing_wheel.h"
+#include "check.h"
+
+using Clock = TimingWheel<int>::Clock;
+using std::chrono::milliseconds;
+
+static void test_fires_at_deadline() {
+    Clock::time_point origin = Clock::now();
+    TimingWheel<int> wheel(milliseconds(1), origin);
+    std::vector<int> due;
+
+    CHECK(wheel.empty() && !wheel.next_expiry());
+    wheel.schedule(origin + milliseconds(5), 1);
+    wheel.schedule(origin + milliseconds(70), 2); // Второй уровень
+    CHECK(wheel.size() == 2 && wheel.next_expiry().has_value());
+
+    CHECK(wheel.advance(origin + milliseconds(4), due) == 0 && due.empty());
+    CHECK(wheel.advance(origin + milliseconds(5), due) == 1 && due == std::vector<int>{ 1 });
+    due.clear();
+    CHECK(wheel.advance(origin + milliseconds(69), due) == 0);
+    CHECK(wheel.advance(origin + milliseconds(70), due) == 1 && due == std::vector<int>{ 2 });
+    CHECK(wheel.empty());
+}
+
+static void test_cancel() {
+    Clock::time_point origin = Clock::now();
+    TimingWheel<int> wheel(milliseconds(1), origin);
+    std::vector<int> due;
+
+    auto handle = wheel.schedule(origin + milliseconds(20), 1);
+    CHECK(wheel.cancel(handle));
+    CHECK(!wheel.cancel(handle));
+    CHECK(wheel.empty());
+    CHECK(wheel.advance(origin + milliseconds(20), due) == 0);
+
+    // Уже выданное значение не отменяется, а старый дескриптор не подходит к новому узлу
+    auto fired = wheel.schedule(origin + milliseconds(30), 2);
+    wheel.advance(origin + milliseconds(30), due);
+    CHECK(!wheel.cancel(fired));
+    auto reused = wheel.schedule(origin + milliseconds(40), 3);
+    CHECK(!wheel.cancel(fired));
+    CHECK(wheel.cancel(reused));
+}
+
+static void test_past_deadline() {
+    Clock::time_point origin = Clock::now();
+    TimingWheel<int> wheel(milliseconds(1), origin);
+    std::vector<int> due;
+
+    wheel.advance(origin + milliseconds(10), due);
+    wheel.schedule(origin, 1);
+    CHECK(wheel.advance(origin + milliseconds(11), due) == 1 && due == std::vector<int>{ 1 });
+}
+
+static void test_cascade() {
+    Clock::time_point origin = Clock::now();
+    TimingWheel<int> wheel(milliseconds(1), origin);
+    std::vector<int> due;
+
+    wheel.schedule(origin + std::chrono::seconds(300), 1);
+    wheel.schedule(origin + std::chrono::hours(100), 2); // Дальше верхнего уровня
+    CHECK(wheel.advance(origin + milliseconds(299999), due) == 0);
+    CHECK(wheel.advance(origin + std::chrono::seconds(300), due) == 1 && due == std::vector<int>{ 1 });
+    due.clear();
+    CHECK(wheel.advance(origin + std::chrono::hours(100) - milliseconds(1), due) == 0);
+    CHECK(wheel.advance(origin + std::chrono::hours(100), due) == 1 && due == std::vector<int>{ 2 });
+}
+
+int main() {
+    test_fires_at_deadline();
+    test_cancel();
+    test_past_deadline();
+    test_cascade();
+    return check_result("timing_wheel_tests");
+}
@@ -0,0 +1,242 @@
+#pragma once
+
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <limits>
+#include <algorithm>
+
+//    : O(1)   ,
+//    ,    .
+// 5   64    1   ~12 ,  
+//         .
+template <class T>
+class TimingWheel {
+public:
+    using Clock = std::chrono::steady_clock;
+    using Handle = uint64_t;
+    static constexpr Handle invalid_handle = 0;
+
+    explicit TimingWheel(std::chrono::milliseconds tick = std::chrono::milliseconds(1), Clock::time_point origin = Clock::now())
+        : tick_(tick), origin_(origin) {
+        for (auto& level : heads_) {
+            for (auto& head : level) {
+                head = npos;
+            }
+        }
+    }
+
+    //     when,    
+    Handle schedule(Clock::time_point when, T value) {
+        uint32_t index;
+        if (free_ != npos) {
+            index = free_;
+            free_ = nodes_[index].next;
+        }
+        else {
+            index = static_cast<uint32_t>(nodes_.size());
+            nodes_.emplace_back();
+        }
+
+        Node& node = nodes_[index];
+        node.value = std::move(value);
+        node.expires = std::max(to_tick(when), current_);
+        node.active = true;
+        place(index);
+        size_++;
+        return (static_cast<Handle>(node.generation) << 32) | index;
+    }
+
+    //   ; false,      
+    bool cancel(Handle handle) {
+        uint32_t index = static_cast<uint32_t>(handle & 0xffffffff);
+        if (index >= nodes_.size()) {
+            return false;
+        }
+        Node& node = nodes_[index];
+        if (!node.active || node.generation != static_cast<uint32_t>(handle >> 32)) {
+            return false;
+        }
+        unlink(index);
+        release(index);
+        return true;
+    }
+
+    //   due  ,      now
+    size_t advance(Clock::time_point now, std::vector<T>& due) {
+        size_t count = 0;
+        uint64_t target = to_tick_floor(now);
+        while (size_ > 0) {
+            uint64_t next = next_tick();
+            if (next > target) {
+                break;
+            }
+            current_ = next;
+
+            //    ,      
+            for (size_t level = levels - 1; level > 0; --level) {
+                if ((current_ & ((uint64_t(1) << (bits * level)) - 1)) == 0) {
+                    cascade(level, static_cast<size_t>((current_ >> (bits * level)) & mask));
+                }
+            }
+
+            size_t slot = static_cast<size_t>(current_ & mask);
+            while (heads_[0][slot] != npos) {
+                uint32_t index = heads_[0][slot];
+                unlink(index);
+                due.push_back(std::move(nodes_[index].value));
+                release(index);
+                count++;
+            }
+            current_++;
+        }
+        if (current_ <= target) {
+            current_ = target + 1;
+        }
+        return count;
+    }
+
+    //  ,     advance
+    std::optional<Clock::time_point> next_expiry() const {
+        if (size_ == 0) {
+            return std::nullopt;
+        }
+        return origin_ + tick_ * static_cast<Clock::rep>(next_tick());
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+    bool empty() const {
+        return size_ == 0;
+    }
+
+private:
+    static constexpr size_t bits = 6;
+    static constexpr size_t slots = size_t(1) << bits;
+    static constexpr uint64_t mask = slots - 1;
+    static constexpr size_t levels = 5;
+    static constexpr uint64_t span = uint64_t(1) << (bits * levels);
+    static constexpr uint32_t npos = std::numeric_limits<uint32_t>::max();
+
+    struct Node {
+        T value{};
+        uint64_t expires = 0;
+        uint32_t prev = npos;
+        uint32_t next = npos;
+        uint32_t generation = 1;
+        uint8_t level = 0;
+        uint8_t slot = 0;
+        bool active = false;
+    };
+
+    uint64_t to_tick(Clock::time_point when) const {
+        if (when <= origin_) {
+            return 0;
+        }
+        auto delta = when - origin_;
+        return static_cast<uint64_t>((delta + tick_ - Clock::duration(1)) / tick_);
+    }
+
+    uint64_t to_tick_floor(Clock::time_point when) const {
+        if (when <= origin_) {
+            return 0;
+        }
+        return static_cast<uint64_t>((when - origin_) / tick_);
+    }
+
+    //         
+    void place(uint32_t index) {
+        Node& node = nodes_[index];
+        uint64_t expires = std::min(node.expires, current_ + span - 1);
+        uint64_t delta = expires - current_;
+        size_t level = 0;
+        while (level + 1 < levels && delta >= (uint64_t(1) << (bits * (level + 1)))) {
+            level++;
+        }
+        size_t slot = static_cast<size_t>((expires >> (bits * level)) & mask);
+
+        node.level = static_cast<uint8_t>(level);
+        node.slot = static_cast<uint8_t>(slot);
+        node.prev = npos;
+        node.next = heads_[level][slot];
+        if (node.next != npos) {
+            nodes_[node.next].prev = index;
+        }
+        heads_[level][slot] = index;
+        occupied_[level] |= uint64_t(1) << slot;
+    }
+
+    void unlink(uint32_t index) {
+        Node& node = nodes_[index];
+        if (node.prev != npos) {
+            nodes_[node.prev].next = node.next;
+        }
+        else {
+            heads_[node.level][node.slot] = node.next;
+        }
+        if (node.next != npos) {
+            nodes_[node.next].prev = node.prev;
+        }
+        if (heads_[node.level][node.slot] == npos) {
+            occupied_[node.level] &= ~(uint64_t(1) << node.slot);
+        }
+    }
+
+    void release(uint32_t index) {
+        Node& node = nodes_[index];
+        node.active = false;
+        node.value = T{};
+        node.generation++;
+        if (node.generation == 0) {
+            node.generation = 1;
+        }
+        node.next = free_;
+        free_ = index;
+        size_--;
+    }
+
+    //         
+    void cascade(size_t level, size_t slot) {
+        uint32_t index = heads_[level][slot];
+        heads_[level][slot] = npos;
+        occupied_[level] &= ~(uint64_t(1) << slot);
+        while (index != npos) {
+            uint32_t next = nodes_[index].next;
+            place(index);
+            index = next;
+        }
+    }
+
+    //   (  current_),       
+    uint64_t next_tick() const {
+        uint64_t best = std::numeric_limits<uint64_t>::max();
+        for (size_t level = 0; level < levels; ++level) {
+            if (occupied_[level] == 0) {
+                continue;
+            }
+            size_t shift = bits * level;
+            uint64_t base = current_ >> shift;
+            //      ,      
+            if (level > 0 && (current_ & ((uint64_t(1) << shift) - 1)) != 0) {
+                base++;
+            }
+            size_t offset = static_cast<size_t>(base & mask);
+            uint64_t rotated = (occupied_[level] >> offset) | (offset ? (occupied_[level] << (slots - offset)) : 0);
+            uint64_t tick = (base + static_cast<uint64_t>(__builtin_ctzll(rotated))) << shift;
+            best = std::min(best, tick);
+        }
+        return best;
+    }
+
+    std::chrono::milliseconds tick_;
+    Clock::time_point origin_;
+    uint64_t current_ = 0;
+    size_t size_ = 0;
+    std::vector<Node> nodes_;
+    uint32_t free_ = npos;
+    uint32_t heads_[levels][slots];
+    uint64_t occupied_[levels] = {};
+};
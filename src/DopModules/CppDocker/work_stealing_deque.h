@@ -0,0 +1,120 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <type_traits>
+
+//  -:          ,
+//         CAS.
+//      (  ).
+template <class T>
+class WorkStealingDeque {
+    static_assert(std::is_trivially_copyable<T>::value, "WorkStealingDeque stores trivially copyable values only");
+
+public:
+    explicit WorkStealingDeque(size_t capacity = 1024) {
+        size_t size = 1;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        arrays_.emplace_back(std::make_unique<Array>(size));
+        array_.store(arrays_.back().get(), std::memory_order_relaxed);
+    }
+
+    WorkStealingDeque(const WorkStealingDeque&) = delete;
+    WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+    //  -
+    void push(T value) {
+        int64_t bottom = bottom_.load(std::memory_order_relaxed);
+        int64_t top = top_.load(std::memory_order_acquire);
+        Array* array = array_.load(std::memory_order_relaxed);
+        if (bottom - top > static_cast<int64_t>(array->mask)) {
+            array = grow(array, top, bottom);
+        }
+        array->put(bottom, value);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom_.store(bottom + 1, std::memory_order_relaxed);
+    }
+
+    //  -,    
+    bool pop(T& value) {
+        int64_t bottom = bottom_.load(std::memory_order_relaxed) - 1;
+        Array* array = array_.load(std::memory_order_relaxed);
+        bottom_.store(bottom, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t top = top_.load(std::memory_order_relaxed);
+
+        if (top > bottom) {
+            bottom_.store(bottom + 1, std::memory_order_relaxed);
+            return false;
+        }
+
+        value = array->get(bottom);
+        if (top == bottom) {
+            //   -   
+            bool won = top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+            bottom_.store(bottom + 1, std::memory_order_relaxed);
+            return won;
+        }
+        return true;
+    }
+
+    //  ,    
+    bool steal(T& value) {
+        int64_t top = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t bottom = bottom_.load(std::memory_order_acquire);
+        if (top >= bottom) {
+            return false;
+        }
+
+        Array* array = array_.load(std::memory_order_acquire);
+        value = array->get(top);
+        return top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+    }
+
+    size_t size() const {
+        int64_t bottom = bottom_.load(std::memory_order_relaxed);
+        int64_t top = top_.load(std::memory_order_relaxed);
+        return bottom > top ? static_cast<size_t>(bottom - top) : 0;
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+private:
+    struct Array {
+        explicit Array(size_t capacity) : mask(capacity - 1), items(new std::atomic<T>[capacity]) {}
+
+        T get(int64_t index) const {
+            return items[static_cast<size_t>(index) & mask].load(std::memory_order_relaxed);
+        }
+
+        void put(int64_t index, T value) {
+            items[static_cast<size_t>(index) & mask].store(value, std::memory_order_relaxed);
+        }
+
+        size_t mask;
+        std::unique_ptr<std::atomic<T>[]> items;
+    };
+
+    //       :      
+    Array* grow(Array* array, int64_t top, int64_t bottom) {
+        arrays_.emplace_back(std::make_unique<Array>((array->mask + 1) * 2));
+        Array* bigger = arrays_.back().get();
+        for (int64_t i = top; i < bottom; ++i) {
+            bigger->put(i, array->get(i));
+        }
+        array_.store(bigger, std::memory_order_release);
+        return bigger;
+    }
+
+    alignas(64) std::atomic<int64_t> top_{ 0 };
+    alignas(64) std::atomic<int64_t> bottom_{ 0 };
+    std::atomic<Array*> array_{ nullptr };
+    std::vector<std::unique_ptr<Array>> arrays_;
+};